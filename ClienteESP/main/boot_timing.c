@@ -0,0 +1,48 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "boot_timing.h"
+#include "esp_log.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_app_desc.h"
+#endif
+
+static const char *TAG = "boot_timing";
+
+// Milisegundos desde el arranque de cada fase (0 = aún no alcanzada)
+static uint32_t phase_ms[BOOT_PHASE_COUNT];
+static bool summary_logged;
+
+void boot_timing_mark(boot_phase_t phase) {
+    if (phase < BOOT_PHASE_COUNT && phase_ms[phase] == 0) {
+        // esp_log_timestamp() cuenta desde el arranque; +1 evita confundir 0 con "sin marcar"
+        phase_ms[phase] = esp_log_timestamp() + 1;
+    }
+}
+
+static int32_t phase_time(boot_phase_t phase) {
+    return phase_ms[phase] ? (int32_t)phase_ms[phase] - 1 : -1;
+}
+
+void boot_timing_log_summary(void) {
+    if (summary_logged) {
+        return;
+    }
+    summary_logged = true;
+
+#if CONFIG_IDF_TARGET_LINUX
+    const char *version = "linux";
+#else
+    const char *version = esp_app_get_description()->version;
+#endif
+    int32_t app = phase_time(BOOT_PHASE_APP_START);
+    int32_t online = phase_time(BOOT_PHASE_FIRST_STATE);
+
+    ESP_LOGI(TAG, "Arranque fw=%s boot=%" PRId32 "ms ip=%" PRId32 "ms tcp=%" PRId32 "ms upgrade=%" PRId32
+             "ms first_state=%" PRId32 "ms total=%" PRId32 "ms",
+             version, app,
+             phase_time(BOOT_PHASE_IP_ACQUIRED),
+             phase_time(BOOT_PHASE_WS_CONNECTING),
+             phase_time(BOOT_PHASE_WS_UPGRADED),
+             online,
+             (app >= 0 && online >= 0) ? online - app : -1);
+}
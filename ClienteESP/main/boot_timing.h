@@ -0,0 +1,17 @@
+#pragma once
+
+// Fases del arranque hasta que el dispositivo está operativo
+typedef enum {
+    BOOT_PHASE_APP_START = 0,   // Entrada en app_main
+    BOOT_PHASE_IP_ACQUIRED,     // WiFi conectado, IP asignada
+    BOOT_PHASE_WS_CONNECTING,   // Inicio de la conexión TCP al servidor
+    BOOT_PHASE_WS_UPGRADED,     // Handshake WebSocket completado
+    BOOT_PHASE_FIRST_STATE,     // Primer estado enviado al servidor
+    BOOT_PHASE_COUNT
+} boot_phase_t;
+
+// Registra el instante de una fase. Sólo cuenta la primera vez de cada arranque.
+void boot_timing_mark(boot_phase_t phase);
+
+// Escribe en el log una única línea con todos los tiempos registrados
+void boot_timing_log_summary(void);
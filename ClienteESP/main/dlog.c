@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include "dlog.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+typedef struct {
+    uint32_t timestamp_ms;
+    uint8_t level;
+    const char *tag;
+    const char *fmt;
+    uint32_t args[3];
+} dlog_record_t;
+
+static const char *TAG = "dlog";
+
+static QueueHandle_t records;
+static volatile uint32_t dropped;
+
+static void dlog_drain_task(void *arg) {
+    dlog_record_t rec;
+    char line[128];
+    uint32_t reported_dropped = 0;
+
+    while (1) {
+        if (xQueueReceive(records, &rec, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        snprintf(line, sizeof(line), rec.fmt, rec.args[0], rec.args[1], rec.args[2]);
+        ESP_LOG_LEVEL((esp_log_level_t)rec.level, rec.tag, "%s (@%" PRIu32 " ms)", line, rec.timestamp_ms);
+
+        uint32_t now_dropped = dropped;
+        if (now_dropped != reported_dropped) {
+            ESP_LOGW(TAG, "%" PRIu32 " registros descartados", now_dropped - reported_dropped);
+            reported_dropped = now_dropped;
+        }
+    }
+}
+
+esp_err_t dlog_init(void) {
+    records = xQueueCreate(CONFIG_DLOG_QUEUE_LEN, sizeof(dlog_record_t));
+    if (records == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Prioridad mínima: la consola sólo avanza cuando no hay otro trabajo
+    if (xTaskCreate(dlog_drain_task, "dlog", 3072, NULL, tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, uint32_t a, uint32_t b, uint32_t c) {
+    if (level > esp_log_level_get(tag)) {
+        return;
+    }
+    dlog_record_t rec = {
+        .timestamp_ms = esp_log_timestamp(),
+        .level = (uint8_t)level,
+        .tag = tag,
+        .fmt = fmt,
+        .args = { a, b, c },
+    };
+    if (records == NULL || xQueueSend(records, &rec, 0) != pdTRUE) {
+        dropped++;
+    }
+}
+
+uint32_t dlog_dropped(void) {
+    return dropped;
+}
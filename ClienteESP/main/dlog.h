@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+// Log diferido para las rutas calientes: cada llamada guarda un registro
+// binario (instante, nivel, etiqueta, formato y hasta tres argumentos de 32
+// bits) en una cola y una tarea de baja prioridad lo formatea y lo escribe.
+// Nunca bloquea: si la cola está llena el registro se descarta y se cuenta.
+//
+// Los niveles por encima de CONFIG_DLOG_LEVEL se eliminan al compilar. El
+// formato debe ser un literal y sus argumentos enteros de 32 bits; el texto
+// se formatea más tarde, así que no se pueden pasar cadenas.
+
+#define DLOG_AT(level, tag, fmt, a, b, c, ...)                                        \
+    do {                                                                              \
+        if ((level) <= CONFIG_DLOG_LEVEL) {                                           \
+            dlog_write((level), (tag), (fmt), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c)); \
+        }                                                                             \
+    } while (0)
+
+#define DLOGE(tag, fmt, ...) DLOG_AT(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__, 0, 0, 0)
+#define DLOGW(tag, fmt, ...) DLOG_AT(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__, 0, 0, 0)
+#define DLOGI(tag, fmt, ...) DLOG_AT(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__, 0, 0, 0)
+#define DLOGD(tag, fmt, ...) DLOG_AT(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__, 0, 0, 0)
+
+// Crea la cola y la tarea de vaciado. Hasta entonces los registros se descartan.
+esp_err_t dlog_init(void);
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *fmt, uint32_t a, uint32_t b, uint32_t c);
+
+// Registros descartados por cola llena desde el arranque
+uint32_t dlog_dropped(void);
@@ -0,0 +1,61 @@
+#include "gpio_outputs.h"
+#include "driver/gpio.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+// Máscaras de registro precalculadas: bit de GPIO_OUT_REG de cada salida
+static uint32_t out_reg_bits[OUTPUTS_MAX];
+static int out_pins[OUTPUTS_MAX];
+static size_t out_count;
+static uint32_t out_levels;
+
+void outputs_init(const int *pins, size_t count, uint32_t initial_levels) {
+    out_count = count > OUTPUTS_MAX ? OUTPUTS_MAX : count;
+
+    for (size_t i = 0; i < out_count; i++) {
+        out_pins[i] = pins[i];
+        // Los pines >= 32 viven en GPIO_OUT1_REG; se escriben uno a uno
+        out_reg_bits[i] = pins[i] < 32 ? (1u << pins[i]) : 0;
+
+        gpio_reset_pin(pins[i]);
+        gpio_set_direction(pins[i], GPIO_MODE_OUTPUT);
+    }
+
+    outputs_write(outputs_all_mask(out_count), initial_levels);
+}
+
+void outputs_write(uint32_t mask, uint32_t levels) {
+    uint32_t reg_set = 0;
+    uint32_t reg_clear = 0;
+
+    for (size_t i = 0; i < out_count; i++) {
+        uint32_t bit = 1u << i;
+        if (!(mask & bit)) {
+            continue;
+        }
+        if (out_reg_bits[i] == 0) {
+            gpio_set_level(out_pins[i], (levels & bit) ? 1 : 0);
+        } else if (levels & bit) {
+            reg_set |= out_reg_bits[i];
+        } else {
+            reg_clear |= out_reg_bits[i];
+        }
+    }
+
+    // Como mucho dos escrituras, sea cual sea el número de salidas: W1TS con
+    // las que se encienden y W1TC con las que se apagan. Sin lectura previa,
+    // no pisan los cambios de otros pines hechos desde otra tarea o el otro
+    // núcleo (gpio_set_level usa los mismos registros).
+    if (reg_set) {
+        REG_WRITE(GPIO_OUT_W1TS_REG, reg_set);
+    }
+    if (reg_clear) {
+        REG_WRITE(GPIO_OUT_W1TC_REG, reg_clear);
+    }
+
+    out_levels = (out_levels & ~mask) | (levels & mask);
+}
+
+uint32_t outputs_get(void) {
+    return out_levels;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+// Número máximo de salidas gestionadas (un bit por salida en las máscaras)
+#define OUTPUTS_MAX 32
+
+// Máscara con las `count` primeras salidas seleccionadas
+static inline uint32_t outputs_all_mask(size_t count) {
+    return count >= OUTPUTS_MAX ? 0xFFFFFFFFu : ((1u << count) - 1);
+}
+
+// Configura los pines como salida y aplica el nivel inicial (bit i = salida i)
+void outputs_init(const int *pins, size_t count, uint32_t initial_levels);
+
+// Aplica el nivel de todas las salidas seleccionadas en `mask` con un número
+// fijo de escrituras de registro: una de GPIO_OUT_W1TS_REG con las que se
+// encienden y otra de GPIO_OUT_W1TC_REG con las que se apagan (los pines >= 32
+// se escriben aparte, uno a uno).
+void outputs_write(uint32_t mask, uint32_t levels);
+
+// Devuelve el último nivel aplicado a cada salida (bit i = salida i)
+uint32_t outputs_get(void);
+
+#if CONFIG_IDF_TARGET_LINUX
+// Estadísticas del stub de GPIO en el target linux, para poder comprobar
+// cuántas escrituras genera cada comando y cuándo se produjeron.
+typedef struct {
+    uint32_t write_count;     // Escrituras de registro simuladas (W1TS y W1TC)
+    int64_t first_write_us;   // Instante de la primera escritura
+    int64_t last_write_us;    // Instante de la última escritura
+    uint32_t last_mask;       // Máscara de la última escritura
+    uint32_t levels;          // Estado actual de las salidas
+} outputs_stub_stats_t;
+
+void outputs_stub_get_stats(outputs_stub_stats_t *stats);
+void outputs_stub_reset_stats(void);
+#endif
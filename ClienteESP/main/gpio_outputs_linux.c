@@ -0,0 +1,71 @@
+#include <time.h>
+#include "gpio_outputs.h"
+#include "esp_log.h"
+
+// Stub de GPIO para el target linux: no toca hardware, sólo registra cada
+// escritura de registro simulada para poder verificar el comportamiento.
+// pytest_websocket_client.py comprueba el número de escrituras por llamada.
+
+static const char *TAG = "gpio_stub";
+
+static size_t out_count;
+static outputs_stub_stats_t stats;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static void record_write(uint32_t mask) {
+    int64_t t = now_us();
+    if (stats.write_count == 0) {
+        stats.first_write_us = t;
+    }
+    stats.write_count++;
+    stats.last_write_us = t;
+    stats.last_mask = mask;
+    ESP_LOGI(TAG, "Escritura #%u mask=0x%08x levels=0x%08x t=%lld us",
+             (unsigned)stats.write_count, (unsigned)mask, (unsigned)stats.levels, (long long)t);
+}
+
+void outputs_init(const int *pins, size_t count, uint32_t initial_levels) {
+    (void)pins;
+    out_count = count > OUTPUTS_MAX ? OUTPUTS_MAX : count;
+    stats.levels = 0;
+    outputs_write(outputs_all_mask(out_count), initial_levels);
+}
+
+void outputs_write(uint32_t mask, uint32_t levels) {
+    mask &= outputs_all_mask(out_count);
+    if (!mask) {
+        return;
+    }
+
+    // Igual que en el hardware: una escritura de W1TS con las salidas que se
+    // encienden y otra de W1TC con las que se apagan
+    stats.levels = (stats.levels & ~mask) | (levels & mask);
+    uint32_t writes = 0;
+    if (levels & mask) {
+        record_write(levels & mask);
+        writes++;
+    }
+    if (mask & ~levels) {
+        record_write(mask & ~levels);
+        writes++;
+    }
+    ESP_LOGI(TAG, "outputs_write: %u escrituras de registro", (unsigned)writes);
+}
+
+uint32_t outputs_get(void) {
+    return stats.levels;
+}
+
+void outputs_stub_get_stats(outputs_stub_stats_t *out) {
+    *out = stats;
+}
+
+void outputs_stub_reset_stats(void) {
+    uint32_t levels = stats.levels;
+    stats = (outputs_stub_stats_t){ .levels = levels };
+}
@@ -0,0 +1,323 @@
+#include <stdbool.h>
+#include <string.h>
+#include "rule_engine.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+
+#define RULES_NAMESPACE "rules"
+#define RULES_KEY       "table"
+
+// Rueda de temporización: WHEEL_SLOTS ranuras de un segundo. Una regla a N
+// segundos va a la ranura (cursor + N) % WHEEL_SLOTS con N / WHEEL_SLOTS
+// vueltas pendientes, así que cada tick sólo recorre su ranura. El timer de
+// la rueda sólo está activo mientras hay reglas programadas.
+#define WHEEL_SLOTS     64
+#define WHEEL_TICK_MS   1000
+#define SECONDS_PER_DAY 86400
+
+static const char *TAG = "rules";
+
+typedef struct {
+    int8_t next;       // Siguiente regla en la misma ranura (-1 = fin)
+    uint8_t slot;
+    uint16_t rounds;   // Vueltas completas que faltan
+    bool armed;
+} wheel_entry_t;
+
+static rule_t rules[RULES_MAX];
+static size_t rule_count;
+static wheel_entry_t entries[RULES_MAX];
+static int8_t slots[WHEEL_SLOTS];
+static uint8_t cursor;
+static size_t armed_count;
+
+static SemaphoreHandle_t rules_lock;
+static TimerHandle_t wheel_timer;
+static rules_apply_cb_t apply_cb;
+static rules_state_cb_t state_cb;
+
+static bool clock_valid;
+static int64_t clock_offset_s;  // Hora local - tiempo desde el arranque
+
+static uint32_t uptime_s(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static uint32_t seconds_of_day(void) {
+    return (uint32_t)((clock_offset_s + uptime_s()) % SECONDS_PER_DAY);
+}
+
+// Las funciones wheel_* se llaman con rules_lock tomado
+static void wheel_insert(size_t index, uint32_t delay_s) {
+    if (delay_s == 0) {
+        delay_s = 1;
+    }
+    wheel_entry_t *e = &entries[index];
+    e->slot = (cursor + delay_s) % WHEEL_SLOTS;
+    e->rounds = (delay_s - 1) / WHEEL_SLOTS;
+    e->next = slots[e->slot];
+    e->armed = true;
+    slots[e->slot] = (int8_t)index;
+
+    if (armed_count++ == 0) {
+        xTimerStart(wheel_timer, 0);
+    }
+}
+
+static void wheel_cancel(size_t index) {
+    wheel_entry_t *e = &entries[index];
+    if (!e->armed) {
+        return;
+    }
+    for (int8_t *link = &slots[e->slot]; *link >= 0; link = &entries[*link].next) {
+        if (*link == (int8_t)index) {
+            *link = e->next;
+            break;
+        }
+    }
+    e->armed = false;
+    armed_count--;
+}
+
+static void wheel_clear(void) {
+    memset(slots, -1, sizeof(slots));
+    memset(entries, 0, sizeof(entries));
+    armed_count = 0;
+}
+
+// Programa la próxima ejecución de una regla temporal, si la tiene
+static void schedule_rule(size_t index) {
+    const rule_t *r = &rules[index];
+    switch (r->trigger) {
+        case RULE_TRIGGER_AFTER:
+        case RULE_TRIGGER_EVERY:
+            wheel_insert(index, r->arg);
+            break;
+        case RULE_TRIGGER_AT:
+            if (clock_valid) {
+                uint32_t delay = (r->arg + SECONDS_PER_DAY - seconds_of_day()) % SECONDS_PER_DAY;
+                wheel_insert(index, delay ? delay : SECONDS_PER_DAY);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Nivel que deja la acción de la regla en su salida destino
+static bool action_level(const rule_t *r, uint32_t state) {
+    switch (r->action) {
+        case RULE_ACTION_ON:
+            return true;
+        case RULE_ACTION_TOGGLE:
+            return !(state & (1u << r->target));
+        case RULE_ACTION_COPY:
+            return state & (1u << r->source);
+        case RULE_ACTION_INVERT:
+            return !(state & (1u << r->source));
+        default:
+            return false;
+    }
+}
+
+static void wheel_tick_cb(TimerHandle_t timer) {
+    uint32_t mask = 0;
+    uint32_t levels = 0;
+    uint32_t state = state_cb();
+
+    xSemaphoreTake(rules_lock, portMAX_DELAY);
+    cursor = (cursor + 1) % WHEEL_SLOTS;
+
+    // Separar la ranura actual: las reglas con vueltas pendientes vuelven a ella
+    int8_t index = slots[cursor];
+    slots[cursor] = -1;
+    while (index >= 0) {
+        wheel_entry_t *e = &entries[index];
+        int8_t next = e->next;
+        armed_count--;
+        e->armed = false;
+
+        if (e->rounds > 0) {
+            e->rounds--;
+            e->next = slots[cursor];
+            e->armed = true;
+            slots[cursor] = index;
+            armed_count++;
+        } else {
+            const rule_t *r = &rules[index];
+            uint32_t bit = 1u << r->target;
+            mask |= bit;
+            levels = action_level(r, state) ? (levels | bit) : (levels & ~bit);
+            if (r->trigger != RULE_TRIGGER_AFTER) {
+                schedule_rule(index);
+            }
+        }
+        index = next;
+    }
+
+    if (armed_count == 0) {
+        xTimerStop(timer, 0);
+    }
+    xSemaphoreGive(rules_lock);
+
+    if (mask) {
+        apply_cb(mask, levels);
+    }
+}
+
+static esp_err_t validate(const rule_t *r, size_t output_count) {
+    if (r->trigger > RULE_TRIGGER_WHEN || r->action > RULE_ACTION_INVERT ||
+        r->target >= output_count || r->source >= output_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    switch (r->trigger) {
+        case RULE_TRIGGER_AFTER:
+        case RULE_TRIGGER_EVERY:
+            return (r->arg > 0 && r->arg <= SECONDS_PER_DAY * 7) ? ESP_OK : ESP_ERR_INVALID_ARG;
+        case RULE_TRIGGER_AT:
+            return r->arg < SECONDS_PER_DAY ? ESP_OK : ESP_ERR_INVALID_ARG;
+        case RULE_TRIGGER_WHEN:
+            return r->arg <= 1 ? ESP_OK : ESP_ERR_INVALID_ARG;
+        default:
+            return ESP_OK;
+    }
+}
+
+static void install(const rule_t *table, size_t count) {
+    xSemaphoreTake(rules_lock, portMAX_DELAY);
+    wheel_clear();
+    memcpy(rules, table, count * sizeof(rule_t));
+    rule_count = count;
+    for (size_t i = 0; i < rule_count; i++) {
+        schedule_rule(i);
+    }
+    if (armed_count == 0) {
+        xTimerStop(wheel_timer, 0);
+    }
+    xSemaphoreGive(rules_lock);
+}
+
+esp_err_t rules_init(rules_apply_cb_t apply, rules_state_cb_t get_state) {
+    apply_cb = apply;
+    state_cb = get_state;
+    wheel_clear();
+
+    rules_lock = xSemaphoreCreateMutex();
+    wheel_timer = xTimerCreate("rules_wheel", pdMS_TO_TICKS(WHEEL_TICK_MS), pdTRUE, NULL, wheel_tick_cb);
+    return (rules_lock && wheel_timer) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t rules_load(const rule_t *table, size_t count, size_t output_count) {
+    if (count > RULES_MAX) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < count; i++) {
+        esp_err_t err = validate(&table[i], output_count);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Regla %u no válida", (unsigned)i);
+            return err;
+        }
+    }
+
+    install(table, count);
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(RULES_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = count ? nvs_set_blob(handle, RULES_KEY, table, count * sizeof(rule_t))
+                    : nvs_erase_key(handle, RULES_KEY);
+        if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "No se pudieron guardar las reglas: %s", esp_err_to_name(err));
+    }
+    ESP_LOGI(TAG, "%u reglas cargadas", (unsigned)count);
+    return ESP_OK;
+}
+
+esp_err_t rules_restore(size_t output_count) {
+    rule_t table[RULES_MAX];
+    size_t size = sizeof(table);
+    nvs_handle_t handle;
+
+    esp_err_t err = nvs_open(RULES_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_blob(handle, RULES_KEY, table, &size);
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t count = size / sizeof(rule_t);
+    for (size_t i = 0; i < count; i++) {
+        if (validate(&table[i], output_count) != ESP_OK) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    install(table, count);
+    ESP_LOGI(TAG, "%u reglas restauradas de NVS", (unsigned)count);
+    return ESP_OK;
+}
+
+void rules_set_clock(uint32_t seconds) {
+    xSemaphoreTake(rules_lock, portMAX_DELAY);
+    clock_offset_s = (int64_t)(seconds % SECONDS_PER_DAY) - uptime_s();
+    clock_offset_s = ((clock_offset_s % SECONDS_PER_DAY) + SECONDS_PER_DAY) % SECONDS_PER_DAY;
+    clock_valid = true;
+
+    // Reprogramar las reglas horarias con la nueva hora
+    for (size_t i = 0; i < rule_count; i++) {
+        if (rules[i].trigger == RULE_TRIGGER_AT) {
+            wheel_cancel(i);
+            schedule_rule(i);
+        }
+    }
+    if (armed_count == 0) {
+        xTimerStop(wheel_timer, 0);
+    }
+    xSemaphoreGive(rules_lock);
+}
+
+uint32_t rules_eval_state(uint32_t previous, uint32_t current, uint32_t *levels) {
+    uint32_t changed = previous ^ current;
+    uint32_t mask = 0;
+    *levels = 0;
+
+    if (changed == 0) {
+        return 0;
+    }
+
+    xSemaphoreTake(rules_lock, portMAX_DELAY);
+    for (size_t i = 0; i < rule_count; i++) {
+        const rule_t *r = &rules[i];
+        uint32_t source_bit = 1u << r->source;
+        if (!(changed & source_bit)) {
+            continue;
+        }
+        if (r->trigger == RULE_TRIGGER_WHEN && ((current & source_bit) != 0) != (r->arg != 0)) {
+            continue;
+        }
+        if (r->trigger != RULE_TRIGGER_FOLLOW && r->trigger != RULE_TRIGGER_WHEN) {
+            continue;
+        }
+        uint32_t bit = 1u << r->target;
+        mask |= bit;
+        *levels = action_level(r, current) ? (*levels | bit) : (*levels & ~bit);
+    }
+    xSemaphoreGive(rules_lock);
+
+    return mask;
+}
+
+size_t rules_count(void) {
+    return rule_count;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// Motor de reglas local: ejecuta automatizaciones por tiempo o por cambios de
+// estado sin pasar por el servidor. Las reglas llegan como una tabla compacta
+// de enteros: [disparador, argumento, origen, destino, acción] por regla.
+
+#define RULES_MAX 16
+
+typedef enum {
+    RULE_TRIGGER_AFTER = 0,   // Una vez, `arg` segundos después de cargar la tabla
+    RULE_TRIGGER_EVERY = 1,   // Cada `arg` segundos
+    RULE_TRIGGER_AT = 2,      // Cada día a las `arg` segundos desde medianoche
+    RULE_TRIGGER_FOLLOW = 3,  // Cuando cambia la salida origen
+    RULE_TRIGGER_WHEN = 4,    // Cuando la salida origen pasa al nivel `arg`
+} rule_trigger_t;
+
+typedef enum {
+    RULE_ACTION_OFF = 0,
+    RULE_ACTION_ON = 1,
+    RULE_ACTION_TOGGLE = 2,
+    RULE_ACTION_COPY = 3,     // Destino = nivel de la salida origen
+    RULE_ACTION_INVERT = 4,   // Destino = nivel inverso de la salida origen
+} rule_action_t;
+
+typedef struct {
+    uint8_t trigger;
+    uint8_t source;
+    uint8_t target;
+    uint8_t action;
+    uint32_t arg;
+} rule_t;
+
+// Aplica en las salidas de `mask` los niveles de `levels`. Lo implementa la
+// aplicación; se llama desde la tarea de temporizadores de FreeRTOS.
+typedef void (*rules_apply_cb_t)(uint32_t mask, uint32_t levels);
+
+// Devuelve el estado actual de las salidas
+typedef uint32_t (*rules_state_cb_t)(void);
+
+esp_err_t rules_init(rules_apply_cb_t apply, rules_state_cb_t get_state);
+
+// Sustituye la tabla de reglas y la guarda en NVS. Valida todas las reglas
+// antes de aplicar ninguna.
+esp_err_t rules_load(const rule_t *rules, size_t count, size_t output_count);
+
+// Carga la última tabla guardada en NVS
+esp_err_t rules_restore(size_t output_count);
+
+// Fija la hora local (segundos desde medianoche) para las reglas RULE_TRIGGER_AT
+void rules_set_clock(uint32_t seconds_of_day);
+
+// Calcula los cambios que provocan las reglas de estado ante la transición
+// previous -> current. Devuelve la máscara de salidas afectadas.
+uint32_t rules_eval_state(uint32_t previous, uint32_t current, uint32_t *levels);
+
+size_t rules_count(void);
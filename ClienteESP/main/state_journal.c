@@ -0,0 +1,27 @@
+#include "state_journal.h"
+
+// La versión v ocupa la posición v % STATE_JOURNAL_SIZE: las versiones son
+// consecutivas, así que sólo hace falta guardar la máscara de cada cambio.
+static uint32_t journal[STATE_JOURNAL_SIZE];
+static uint32_t current_version;
+
+uint32_t state_journal_record(uint32_t mask) {
+    current_version++;
+    journal[current_version % STATE_JOURNAL_SIZE] = mask;
+    return current_version;
+}
+
+uint32_t state_journal_version(void) {
+    return current_version;
+}
+
+bool state_journal_changes_since(uint32_t since, uint32_t *changed) {
+    *changed = 0;
+    if (since > current_version || current_version - since > STATE_JOURNAL_SIZE) {
+        return false;
+    }
+    for (uint32_t v = since + 1; v <= current_version; v++) {
+        *changed |= journal[v % STATE_JOURNAL_SIZE];
+    }
+    return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Diario en RAM de los cambios de estado de las salidas. Cada cambio recibe
+// una versión creciente; tras una reconexión basta con enviar las salidas
+// cambiadas después de la última versión confirmada por el servidor.
+
+#define STATE_JOURNAL_SIZE 32
+
+// Registra un cambio de las salidas de `mask` y devuelve su versión
+uint32_t state_journal_record(uint32_t mask);
+
+// Versión del último cambio registrado (0 = ninguno desde el arranque)
+uint32_t state_journal_version(void);
+
+// Calcula en `changed` las salidas modificadas después de `since`. Devuelve
+// false si el diario ya no cubre esa versión y hace falta el estado completo.
+bool state_journal_changes_since(uint32_t since, uint32_t *changed);
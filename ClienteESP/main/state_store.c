@@ -0,0 +1,198 @@
+#include <stdbool.h>
+#include "state_store.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#define STATE_NAMESPACE "outputs"
+#define STATE_KEY       "levels"
+
+static const char *TAG = "state_store";
+
+static portMUX_TYPE store_lock = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t flush_timer;
+static TaskHandle_t flush_task;
+static state_store_stats_t stats;
+
+static uint32_t pending_levels;
+static uint32_t saved_levels;
+static bool dirty;
+static bool writing;            // Escritura en curso de pending_levels
+static uint32_t change_count;   // Sube con cada state_store_save
+static bool has_saved;
+static bool has_written;
+static TickType_t first_dirty_tick;
+static TickType_t last_change_tick;
+static TickType_t last_write_tick;
+
+// Ticks que faltan para escribir: fin del debounce, acotado a que ningún
+// cambio espere más que el intervalo mínimo, y nunca antes de que pase el
+// intervalo mínimo desde la última escritura real.
+static TickType_t ticks_until_flush(TickType_t now) {
+    const TickType_t debounce = pdMS_TO_TICKS(CONFIG_STATE_STORE_DEBOUNCE_MS);
+    const TickType_t min_interval = pdMS_TO_TICKS(CONFIG_STATE_STORE_MIN_INTERVAL_MS);
+
+    TickType_t since_change = now - last_change_tick;
+    TickType_t since_first = now - first_dirty_tick;
+    TickType_t wait = since_change < debounce ? debounce - since_change : 0;
+    TickType_t cap = since_first < min_interval ? min_interval - since_first : 0;
+    if (wait > cap) {
+        wait = cap;
+    }
+
+    if (has_written) {
+        TickType_t since_write = now - last_write_tick;
+        if (since_write < min_interval && wait < min_interval - since_write) {
+            wait = min_interval - since_write;
+        }
+    }
+    return wait ? wait : 1;
+}
+
+static esp_err_t write_levels(uint32_t levels) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(STATE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_u32(handle, STATE_KEY, levels);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+// Escritura en NVS. Se ejecuta en su propia tarea: el borrado de página y el
+// commit pueden tardar decenas de ms y bloquearían la tarea de temporizadores.
+static void flush_pending(void) {
+    TickType_t now = xTaskGetTickCount();
+    const TickType_t min_interval = pdMS_TO_TICKS(CONFIG_STATE_STORE_MIN_INTERVAL_MS);
+
+    portENTER_CRITICAL(&store_lock);
+    if (!dirty) {
+        portEXIT_CRITICAL(&store_lock);
+        return;
+    }
+    if (has_written && (TickType_t)(now - last_write_tick) < min_interval) {
+        TickType_t wait = ticks_until_flush(now);
+        portEXIT_CRITICAL(&store_lock);
+        xTimerChangePeriod(flush_timer, wait, portMAX_DELAY);
+        return;
+    }
+    uint32_t levels = pending_levels;
+    uint32_t changes = change_count;
+    bool unchanged = has_saved && levels == saved_levels;
+    if (unchanged) {
+        dirty = false;
+        stats.coalesced++;
+    } else {
+        writing = true;
+    }
+    portEXIT_CRITICAL(&store_lock);
+
+    if (unchanged) {
+        return;
+    }
+
+    // `dirty` sigue activo hasta que el commit termina bien: si falla, el
+    // estado pendiente se reintenta tras otro debounce
+    esp_err_t err = write_levels(levels);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error guardando estado en NVS: %s", esp_err_to_name(err));
+        portENTER_CRITICAL(&store_lock);
+        writing = false;
+        portEXIT_CRITICAL(&store_lock);
+        TickType_t retry = pdMS_TO_TICKS(CONFIG_STATE_STORE_DEBOUNCE_MS);
+        xTimerChangePeriod(flush_timer, retry ? retry : 1, portMAX_DELAY);
+        return;
+    }
+
+    portENTER_CRITICAL(&store_lock);
+    writing = false;
+    // Un cambio llegado durante la escritura queda pendiente (ya ha rearmado
+    // el temporizador)
+    if (change_count == changes) {
+        dirty = false;
+    }
+    saved_levels = levels;
+    has_saved = true;
+    has_written = true;
+    last_write_tick = now;
+    stats.writes++;
+    portEXIT_CRITICAL(&store_lock);
+
+    ESP_LOGI(TAG, "Estado guardado: 0x%08" PRIx32 " (escrituras=%" PRIu32 ", evitadas=%" PRIu32 ")",
+             levels, stats.writes, stats.coalesced);
+}
+
+static void flush_task_main(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        flush_pending();
+    }
+}
+
+// El temporizador sólo despierta a la tarea de escritura
+static void flush_timer_cb(TimerHandle_t timer) {
+    xTaskNotifyGive(flush_task);
+}
+
+esp_err_t state_store_init(void) {
+    if (xTaskCreate(flush_task_main, "state_store", 3072, NULL, tskIDLE_PRIORITY + 1, &flush_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    // Con pocos ticks por segundo un debounce muy corto daría un periodo de 0
+    TickType_t period = pdMS_TO_TICKS(CONFIG_STATE_STORE_DEBOUNCE_MS);
+    flush_timer = xTimerCreate("state_store", period ? period : 1, pdFALSE, NULL, flush_timer_cb);
+    return flush_timer ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t state_store_load(uint32_t *levels) {
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(STATE_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_u32(handle, STATE_KEY, levels);
+    nvs_close(handle);
+
+    if (err == ESP_OK) {
+        // Lo que hay en flash ya es el estado guardado: no hace falta reescribirlo
+        saved_levels = *levels;
+        has_saved = true;
+    }
+    return err;
+}
+
+void state_store_save(uint32_t levels) {
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&store_lock);
+    stats.requests++;
+    if (!dirty || writing) {
+        // Con una escritura en curso el cambio necesita otra
+        dirty = true;
+        first_dirty_tick = now;
+    } else {
+        // El valor pendiente se sustituye: una escritura menos en flash
+        stats.coalesced++;
+    }
+    pending_levels = levels;
+    change_count++;
+    last_change_tick = now;
+    TickType_t wait = ticks_until_flush(now);
+    portEXIT_CRITICAL(&store_lock);
+
+    if (flush_timer) {
+        xTimerChangePeriod(flush_timer, wait, 0);
+    }
+}
+
+void state_store_get_stats(state_store_stats_t *out) {
+    portENTER_CRITICAL(&store_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&store_lock);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+// Contadores de la persistencia del estado de las salidas
+typedef struct {
+    uint32_t requests;   // Cambios de estado notificados
+    uint32_t writes;     // Escrituras reales en NVS
+    uint32_t coalesced;  // Escrituras evitadas (agrupadas o sin cambios)
+} state_store_stats_t;
+
+// Prepara el temporizador y la tarea de escritura. Requiere nvs_flash_init() previo.
+esp_err_t state_store_init(void);
+
+// Lee el último estado guardado. Devuelve ESP_ERR_NVS_NOT_FOUND si no hay ninguno.
+esp_err_t state_store_load(uint32_t *levels);
+
+// Programa la escritura del estado. Los cambios seguidos se agrupan en una sola
+// escritura tras CONFIG_STATE_STORE_DEBOUNCE_MS sin cambios, respetando siempre
+// CONFIG_STATE_STORE_MIN_INTERVAL_MS entre dos escrituras consecutivas.
+void state_store_save(uint32_t levels);
+
+void state_store_get_stats(state_store_stats_t *stats);
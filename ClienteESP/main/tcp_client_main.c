@@ -1,18 +1,36 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "esp_log.h"
 #include "esp_websocket_client.h"
-#include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_system.h"
+#include "esp_netif.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_wifi.h"
+#include "esp_heap_caps.h"
+#include "wifi_link.h"
+#endif
 #include "protocol_examples_common.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "driver/gpio.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "cJSON.h"
-
-#define WS_SERVER_URI "ws://192.168.1.6:80"
+#include "gpio_outputs.h"
+#include "state_store.h"
+#include "boot_timing.h"
+#include "state_journal.h"
+#include "rule_engine.h"
+#include "dlog.h"
+#include "protocol_c.h"
+#if CONFIG_TELEMETRY_ENABLE
+#include "telemetry.h"
+#endif
+
+#define WS_SERVER_URI CONFIG_EXAMPLE_WEBSOCKET_URI
 #define RETRY_TIMEOUT_MS (5000)
 
 // Definición de pines para LEDs
@@ -22,117 +40,550 @@
 
 static const char *TAG = "WebSocket_Client";
 
-// Estructura para mantener el estado de los LEDs
+// La tarea del WebSocket prepara el cliente mientras el WiFi se asocia y
+// espera este bit para empezar a conectar
+#define NETWORK_READY_BIT BIT0
+static EventGroupHandle_t network_events;
+
+// Tabla de salidas: el índice en la tabla es el bit en las máscaras de estado
 typedef struct {
-    bool led_1_state;
-    bool led_2_state;
-    bool led_3_state;
-} led_state_t;
-
-static led_state_t led_state = {
-    .led_1_state = false,
-    .led_2_state = false,
-    .led_3_state = false
+    const char *identifier;
+    int pin;
+} led_output_t;
+
+static const led_output_t led_outputs[] = {
+    { "led_1", LED_PIN_1 },
+    { "led_2", LED_PIN_2 },
+    { "led_3", LED_PIN_3 },
 };
 
-// Función para inicializar los GPIOs
+#define LED_COUNT (sizeof(led_outputs) / sizeof(led_outputs[0]))
+
+// Estado de los LEDs (bit i = led_outputs[i])
+static uint32_t led_state = 0;
+
+// Protege led_state: lo modifican los comandos y las reglas locales
+static SemaphoreHandle_t state_lock;
+
+// Profundidad máxima de encadenamiento de reglas de estado (evita bucles)
+#define RULE_CASCADE_MAX 4
+
+// Tarea del cliente: envía al servidor los cambios hechos por las reglas
+static TaskHandle_t ws_task;
+
+// Contadores de conexión para el mensaje de salud
+typedef struct {
+    uint32_t ws_connects;
+    uint32_t ws_disconnects;
+    uint32_t ws_errors;
+    uint32_t wifi_disconnects;
+} link_counters_t;
+
+static link_counters_t link_counters;
+
+// Tareas cuyo margen de pila se informa en el mensaje de salud
+static const char *const health_tasks[] = {
+    "websocket_client", "websocket_task", "telemetry", "dlog", "state_store", "Tmr Svc", "esp_timer",
+};
+
+// Última versión del diario de estado confirmada por el servidor
+static uint32_t acked_version;
+static bool server_acked;
+
+// Función para inicializar los GPIOs con el último estado guardado en NVS
 static void init_gpio(void) {
-    gpio_reset_pin(LED_PIN_1);
-    gpio_reset_pin(LED_PIN_2);
-    gpio_reset_pin(LED_PIN_3);
-    
-    gpio_set_direction(LED_PIN_1, GPIO_MODE_OUTPUT);
-    gpio_set_direction(LED_PIN_2, GPIO_MODE_OUTPUT);
-    gpio_set_direction(LED_PIN_3, GPIO_MODE_OUTPUT);
-    
-    gpio_set_level(LED_PIN_1, 0);
-    gpio_set_level(LED_PIN_2, 0);
-    gpio_set_level(LED_PIN_3, 0);
+    uint32_t saved;
+    if (state_store_load(&saved) == ESP_OK) {
+        led_state = saved & outputs_all_mask(LED_COUNT);
+        ESP_LOGI(TAG, "Estado restaurado de NVS: 0x%08" PRIx32, led_state);
+    }
+
+    int pins[LED_COUNT];
+    for (size_t i = 0; i < LED_COUNT; i++) {
+        pins[i] = led_outputs[i].pin;
+    }
+    outputs_init(pins, LED_COUNT, led_state);
+}
+
+// Devuelve el índice de la salida con ese identificador o -1 si no existe.
+// `identifier` no tiene por qué terminar en '\0' (puede apuntar al mensaje).
+static int find_led_index(const char *identifier, size_t len) {
+    for (size_t i = 0; i < LED_COUNT; i++) {
+        if (strlen(led_outputs[i].identifier) == len && memcmp(identifier, led_outputs[i].identifier, len) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Tamaño de los mensajes escritos con el núcleo del protocolo (una
+// confirmación con traza de TRACE_ID_MAX caracteres ocupa hasta 214 bytes)
+#define PROTO_BUF_SIZE 256
+// Mensaje de salud: métricas más el margen de pila de cada tarea de health_tasks
+#define HEALTH_BUF_SIZE 512
+// Identificadores de traza más largos se ignoran
+#define TRACE_ID_MAX 32
+
+// Ventana de secuencias ya aplicadas, para descartar comandos repetidos
+// (p. ej. reenviados por el servidor tras una reconexión). El bit i de
+// `seen` indica si se aplicó `highest - i`. Sobrevive a las reconexiones
+// del WebSocket pero no a un reinicio.
+#define SEQ_WINDOW_SIZE 64
+
+typedef struct {
+    bool valid;
+    uint32_t highest;
+    uint64_t seen;
+} seq_window_t;
+
+static seq_window_t command_window;
+
+// Devuelve true si la secuencia es nueva y la marca como aplicada
+static bool seq_window_accept(seq_window_t *w, uint32_t seq) {
+    if (!w->valid) {
+        w->valid = true;
+        w->highest = seq;
+        w->seen = 1;
+        return true;
+    }
+    if ((int32_t)(seq - w->highest) > 0) {
+        uint32_t shift = seq - w->highest;
+        w->seen = shift >= SEQ_WINDOW_SIZE ? 0 : w->seen << shift;
+        w->seen |= 1;
+        w->highest = seq;
+        return true;
+    }
+    uint32_t age = w->highest - seq;
+    if (age >= SEQ_WINDOW_SIZE) {
+        // Demasiado antigua para saberlo: se trata como repetida
+        return false;
+    }
+    if (w->seen & (1ULL << age)) {
+        return false;
+    }
+    w->seen |= 1ULL << age;
+    return true;
+}
+
+// Confirma un comando sin otra respuesta: repetido (no se vuelve a aplicar) o
+// que no se ha podido aplicar. Sin confirmación el servidor lo tendría en su
+// ventana hasta que venciera.
+static void send_ack(esp_websocket_client_handle_t client, uint32_t seq, bool duplicate) {
+    char buf[48];
+    size_t len = proto_write_ack(buf, sizeof(buf), seq, duplicate);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+    }
+    if (duplicate) {
+        DLOGW(TAG, "Comando repetido, seq=%" PRIu32, seq);
+    } else {
+        DLOGW(TAG, "Comando no aplicado, seq=%" PRIu32, seq);
+    }
 }
 
 // Función para enviar información del dispositivo
 static void send_device_info(esp_websocket_client_handle_t client, const char* id) {
-    cJSON *root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "device_connected");
-    cJSON_AddStringToObject(root, "identifier", id);
-    cJSON_AddStringToObject(root, "ip", "192.168.1.6"); // Reemplazar con IP real
-
-    char *json_str = cJSON_Print(root);
-    esp_websocket_client_send_text(client, json_str, strlen(json_str), portMAX_DELAY);
-    ESP_LOGI(TAG, "Enviando info del dispositivo: %s", json_str);
-    
-    free(json_str);
-    cJSON_Delete(root);
-
-    // Enviar estado inicial
-    root = cJSON_CreateObject();
-    cJSON_AddStringToObject(root, "type", "state_update");
-    cJSON_AddStringToObject(root, "identifier", id);
-    cJSON_AddStringToObject(root, "state", "off");
-    cJSON_AddStringToObject(root, "ip", "192.168.1.6"); // Reemplazar con IP real
-
-    json_str = cJSON_Print(root);
-    esp_websocket_client_send_text(client, json_str, strlen(json_str), portMAX_DELAY);
-    ESP_LOGI(TAG, "Enviando estado inicial: %s", json_str);
-    
-    free(json_str);
-    cJSON_Delete(root);
+    char buf[PROTO_BUF_SIZE];
+    // Última secuencia aplicada: el servidor continúa la numeración desde aquí
+    size_t len = proto_write_device_connected(buf, sizeof(buf), id, "192.168.1.6", // Reemplazar con IP real
+                                              command_window.valid ? &command_window.highest : NULL);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+        ESP_LOGI(TAG, "Enviando info del dispositivo: %s", buf);
+    }
+
+    // Enviar estado inicial (el restaurado de NVS)
+    int index = find_led_index(id, strlen(id));
+    bool on = index >= 0 && (led_state & (1u << index));
+    uint32_t version = state_journal_version();
+    len = proto_write_state_update(buf, sizeof(buf), id, on, "192.168.1.6", &version, NULL, NULL);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+        ESP_LOGI(TAG, "Enviando estado inicial: %s", buf);
+    }
+}
+
+// Aplica niveles a las salidas y propaga las reglas de estado locales.
+// Devuelve la máscara de salidas que han cambiado.
+static uint32_t apply_outputs(uint32_t mask, uint32_t levels) {
+    xSemaphoreTake(state_lock, portMAX_DELAY);
+    uint32_t start = led_state;
+
+    for (int depth = 0; mask && depth < RULE_CASCADE_MAX; depth++) {
+        uint32_t previous = led_state;
+        led_state = (led_state & ~mask) | (levels & mask);
+        if (led_state == previous) {
+            break;
+        }
+        outputs_write(mask, led_state);
+        state_journal_record(led_state ^ previous);
+        mask = rules_eval_state(previous, led_state, &levels) & outputs_all_mask(LED_COUNT);
+    }
+
+    uint32_t changed = led_state ^ start;
+    if (changed) {
+        state_store_save(led_state);
+    }
+    xSemaphoreGive(state_lock);
+    return changed;
 }
 
 // Función para actualizar el estado de un LED
-static void update_led_state(const char* identifier, bool state) {
-    int pin = -1;
-    
-    if (strcmp(identifier, "led_1") == 0) {
-        pin = LED_PIN_1;
-        led_state.led_1_state = state;
-    } else if (strcmp(identifier, "led_2") == 0) {
-        pin = LED_PIN_2;
-        led_state.led_2_state = state;
-    } else if (strcmp(identifier, "led_3") == 0) {
-        pin = LED_PIN_3;
-        led_state.led_3_state = state;
+static uint32_t update_led_state(int index, bool state) {
+    uint32_t bit = 1u << index;
+    return apply_outputs(bit, state ? bit : 0);
+}
+
+// Aplica varias salidas a la vez (bit i = led_outputs[i])
+static uint32_t update_led_states(uint32_t mask, uint32_t states) {
+    return apply_outputs(mask & outputs_all_mask(LED_COUNT), states);
+}
+
+static uint32_t get_led_state(void) {
+    return led_state;
+}
+
+// Objeto "states" con el estado de las salidas de `mask`
+static void write_states(proto_writer_t *w, uint32_t mask, uint32_t state) {
+    proto_writer_open(w, "states");
+    for (size_t i = 0; i < LED_COUNT; i++) {
+        if (mask & (1u << i)) {
+            proto_writer_state(w, led_outputs[i].identifier, state & (1u << i));
+        }
+    }
+    proto_writer_close(w);
+}
+
+// Envía un único state_update con el estado de todas las salidas de `mask`
+static void send_combined_state(esp_websocket_client_handle_t client, uint32_t mask, int64_t seq) {
+    char buf[PROTO_BUF_SIZE];
+    uint32_t state = led_state;
+    uint32_t version = state_journal_version();
+
+    proto_writer_t w;
+    proto_writer_begin(&w, buf, sizeof(buf), PROTO_MSG_STATE_UPDATE);
+    write_states(&w, mask, state);
+    proto_writer_u32(&w, "mask", mask);
+    proto_writer_u32(&w, "state_bits", state & mask);
+    proto_writer_str(&w, "ip", "192.168.1.6"); // Reemplazar con IP real
+    proto_writer_u32(&w, "version", version);
+    if (seq >= 0) {
+        proto_writer_u32(&w, "seq", (uint32_t)seq);
+    }
+    size_t len = proto_writer_finish(&w);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+    }
+    DLOGI(TAG, "Estado combinado: mask=0x%" PRIx32 " bits=0x%" PRIx32 " v%" PRIu32, mask, state & mask, version);
+    ESP_LOGD(TAG, "Enviando estado combinado: %s", buf);
+}
+
+// Callback del motor de reglas (tarea de temporizadores): aplica la acción y
+// pasa las salidas cambiadas a la tarea del cliente, que es la que envía. Así
+// un socket atascado no bloquea los temporizadores (reglas, guardado en NVS).
+static void apply_rule_outputs(uint32_t mask, uint32_t levels) {
+    uint32_t changed = apply_outputs(mask, levels);
+    if (changed && ws_task) {
+        // Los bits se acumulan hasta que la tarea los recoge
+        xTaskNotify(ws_task, changed, eSetBits);
     }
+}
 
-    if (pin != -1) {
-        gpio_set_level(pin, state);
+// Campo entero de una regla. Se comprueba el rango sobre el double antes de
+// convertirlo: fuera de rango la conversión truncaría (259 -> 3) o sería UB.
+static bool rule_field(const cJSON *item, double max, uint32_t *out) {
+    if (!cJSON_IsNumber(item)) {
+        return false;
+    }
+    double value = item->valuedouble;
+    if (!(value >= 0 && value <= max) || value != (double)(uint32_t)value) {
+        return false;
     }
+    *out = (uint32_t)value;
+    return true;
 }
 
-// Función para manejar mensajes recibidos
-static void handle_websocket_message(esp_websocket_client_handle_t client, const char* data) {
-    cJSON *root = cJSON_Parse(data);
-    if (root == NULL) {
-        ESP_LOGE(TAG, "Error parsing JSON");
+// Carga una tabla de reglas: {"type":"rules","ip":"192.168.1.6","rules":[[disparador, arg, origen, destino, acción], ...]}
+// Devuelve false si no ha enviado respuesta.
+static bool handle_rules_message(esp_websocket_client_handle_t client, cJSON *root, int64_t seq) {
+    cJSON *table = cJSON_GetObjectItem(root, "rules");
+    if (!cJSON_IsArray(table) || cJSON_GetArraySize(table) > RULES_MAX) {
+        ESP_LOGE(TAG, "Tabla de reglas no válida");
+        return false;
+    }
+
+    rule_t rules[RULES_MAX];
+    size_t count = 0;
+    bool valid = true;
+    cJSON *entry;
+    cJSON_ArrayForEach(entry, table) {
+        // Límites del tipo de cada campo; rules_load valida luego los valores
+        static const double limits[5] = { UINT8_MAX, UINT32_MAX, UINT8_MAX, UINT8_MAX, UINT8_MAX };
+        uint32_t f[5];
+        if (!cJSON_IsArray(entry) || cJSON_GetArraySize(entry) != 5) {
+            valid = false;
+            break;
+        }
+        for (int i = 0; i < 5 && valid; i++) {
+            valid = rule_field(cJSON_GetArrayItem(entry, i), limits[i], &f[i]);
+        }
+        if (!valid) {
+            break;
+        }
+        rules[count++] = (rule_t){
+            .trigger = (uint8_t)f[0],
+            .arg = f[1],
+            .source = (uint8_t)f[2],
+            .target = (uint8_t)f[3],
+            .action = (uint8_t)f[4],
+        };
+    }
+
+    esp_err_t err = valid ? rules_load(rules, count, LED_COUNT) : ESP_ERR_INVALID_ARG;
+
+    uint32_t clock;
+    if (err == ESP_OK && rule_field(cJSON_GetObjectItem(root, "clock"), 86399, &clock)) {
+        rules_set_clock(clock);
+    }
+
+    char buf[PROTO_BUF_SIZE];
+    proto_writer_t w;
+    proto_writer_begin(&w, buf, sizeof(buf), PROTO_MSG_RULES_LOADED);
+    proto_writer_bool(&w, "ok", err == ESP_OK);
+    proto_writer_u32(&w, "count", err == ESP_OK ? (uint32_t)count : 0);
+    if (seq >= 0) {
+        proto_writer_u32(&w, "seq", (uint32_t)seq);
+    }
+    size_t len = proto_writer_finish(&w);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+    }
+    ESP_LOGI(TAG, "Reglas: %s", buf);
+    return true;
+}
+
+// Envía métricas de memoria, pilas y conexión para detectar fragmentación
+// y falta de pila antes de que el dispositivo falle
+static void send_health(esp_websocket_client_handle_t client) {
+    char buf[HEALTH_BUF_SIZE];
+    proto_writer_t w;
+    proto_writer_begin(&w, buf, sizeof(buf), PROTO_MSG_HEALTH);
+    proto_writer_u32(&w, "uptime_s", esp_log_timestamp() / 1000);
+    proto_writer_u32(&w, "heap_free", esp_get_free_heap_size());
+    proto_writer_u32(&w, "heap_min", esp_get_minimum_free_heap_size());
+#if !CONFIG_IDF_TARGET_LINUX
+    proto_writer_u32(&w, "heap_largest", (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        proto_writer_i32(&w, "rssi", ap.rssi);
+    }
+    proto_writer_u32(&w, "wifi_ip_ms", wifi_link_time_to_ip_ms());
+#endif
+    proto_writer_u32(&w, "ws_connects", link_counters.ws_connects);
+    proto_writer_u32(&w, "ws_disconnects", link_counters.ws_disconnects);
+    proto_writer_u32(&w, "ws_errors", link_counters.ws_errors);
+    proto_writer_u32(&w, "wifi_disconnects", link_counters.wifi_disconnects);
+
+    state_store_stats_t store;
+    state_store_get_stats(&store);
+    proto_writer_u32(&w, "nvs_writes", store.writes);
+    proto_writer_u32(&w, "nvs_coalesced", store.coalesced);
+    proto_writer_u32(&w, "log_dropped", dlog_dropped());
+
+    // Margen mínimo de pila (bytes) de cada tarea conocida
+    proto_writer_open(&w, "stack_free");
+    for (size_t i = 0; i < sizeof(health_tasks) / sizeof(health_tasks[0]); i++) {
+        TaskHandle_t task = xTaskGetHandle(health_tasks[i]);
+        if (task) {
+            proto_writer_u32(&w, health_tasks[i], (uint32_t)uxTaskGetStackHighWaterMark(task));
+        }
+    }
+    proto_writer_close(&w);
+
+    size_t len = proto_writer_finish(&w);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+        ESP_LOGI(TAG, "Salud: %s", buf);
+    } else {
+        ESP_LOGW(TAG, "Mensaje de salud demasiado largo");
+    }
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        link_counters.wifi_disconnects++;
+    }
+}
+#endif
+
+// Anuncia todas las salidas con su estado actual (primera conexión o si el
+// servidor ha perdido el estado)
+static void send_full_state(esp_websocket_client_handle_t client) {
+    for (size_t i = 0; i < LED_COUNT; i++) {
+        send_device_info(client, led_outputs[i].identifier);
+    }
+}
+
+// Tras una reconexión envía sólo las salidas cambiadas desde la última versión
+// confirmada; si el diario ya no la cubre, el estado completo
+static void send_state_resync(esp_websocket_client_handle_t client) {
+    uint32_t changed;
+    if (!server_acked || !state_journal_changes_since(acked_version, &changed)) {
+        send_full_state(client);
+        return;
+    }
+
+    char buf[PROTO_BUF_SIZE];
+    proto_writer_t w;
+    proto_writer_begin(&w, buf, sizeof(buf), PROTO_MSG_STATE_DELTA);
+    proto_writer_u32(&w, "from", acked_version);
+    proto_writer_u32(&w, "version", state_journal_version());
+    if (command_window.valid) {
+        proto_writer_u32(&w, "last_seq", command_window.highest);
+    }
+    write_states(&w, changed, led_state);
+
+    size_t len = proto_writer_finish(&w);
+    if (len) {
+        esp_websocket_client_send_text(client, buf, len, portMAX_DELAY);
+        ESP_LOGI(TAG, "Enviando cambios desde v%" PRIu32 ": %s", acked_version, buf);
+    }
+}
+
+// toggle_device: se resuelve sin construir un árbol cJSON. Si el comando trae
+// "trace", la confirmación lo devuelve con los tiempos medidos desde
+// `received_us` (recepción del mensaje). Devuelve false si no ha enviado
+// confirmación (comando mal formado o salida desconocida).
+static bool handle_toggle(esp_websocket_client_handle_t client, const char *data, size_t len, int64_t seq,
+                          int64_t received_us) {
+    const char *identifier, *state;
+    size_t identifier_len, state_len;
+    if (!proto_get_string(data, len, "identifier", &identifier, &identifier_len) ||
+        !proto_get_string(data, len, "state", &state, &state_len)) {
+        return false;
+    }
+    int index = find_led_index(identifier, identifier_len);
+    if (index < 0) {
+        return false;
+    }
+
+    bool new_state = state_len == 2 && memcmp(state, "on", 2) == 0;
+    uint32_t changed = update_led_state(index, new_state);
+    int64_t applied_us = esp_timer_get_time();
+
+    proto_trace_t trace;
+    bool traced = proto_get_string(data, len, "trace", &trace.id, &trace.id_len) &&
+                  trace.id_len > 0 && trace.id_len <= TRACE_ID_MAX;
+
+    // Enviar confirmación
+    char buf[PROTO_BUF_SIZE];
+    uint32_t version = state_journal_version();
+    uint32_t seq_value = (uint32_t)seq;
+    if (traced) {
+        trace.apply_us = (uint32_t)(applied_us - received_us);
+        trace.total_us = (uint32_t)(esp_timer_get_time() - received_us);
+    }
+    size_t out_len = proto_write_state_update(buf, sizeof(buf), led_outputs[index].identifier, new_state,
+                                              "192.168.1.6", // Reemplazar con IP real
+                                              &version, seq >= 0 ? &seq_value : NULL,
+                                              traced ? &trace : NULL);
+    if (out_len) {
+        esp_websocket_client_send_text(client, buf, out_len, portMAX_DELAY);
+        DLOGI(TAG, "Confirmación: salida %d -> %" PRIu32 ", seq %" PRId32,
+              index, (uint32_t)new_state, (int32_t)seq);
+        ESP_LOGD(TAG, "Enviando confirmación: %s", buf);
+    }
+
+    // Salidas cambiadas por reglas locales encadenadas
+    uint32_t cascaded = changed & ~(1u << index);
+    if (cascaded) {
+        send_combined_state(client, cascaded, -1);
+    }
+    return out_len > 0;
+}
+
+// Función para manejar mensajes recibidos. `data` no termina en '\0'.
+static void handle_websocket_message(esp_websocket_client_handle_t client, const char *data, size_t len) {
+    int64_t received_us = esp_timer_get_time();
+    proto_msg_type_t type = proto_message_type(data, len);
+    if (type == PROTO_MSG_UNKNOWN) {
+        ESP_LOGD(TAG, "Mensaje ignorado");
         return;
     }
 
-    cJSON *type = cJSON_GetObjectItem(root, "type");
-    if (cJSON_IsString(type) && strcmp(type->valuestring, "toggle_device") == 0) {
-        cJSON *identifier = cJSON_GetObjectItem(root, "identifier");
-        cJSON *state = cJSON_GetObjectItem(root, "state");
-
-        if (cJSON_IsString(identifier) && cJSON_IsString(state)) {
-            bool new_state = (strcmp(state->valuestring, "on") == 0);
-            update_led_state(identifier->valuestring, new_state);
-
-            // Enviar confirmación
-            cJSON *response = cJSON_CreateObject();
-            cJSON_AddStringToObject(response, "type", "state_update");
-            cJSON_AddStringToObject(response, "identifier", identifier->valuestring);
-            cJSON_AddStringToObject(response, "state", new_state ? "on" : "off");
-            cJSON_AddStringToObject(response, "ip", "192.168.1.6"); // Reemplazar con IP real
-
-            char *json_str = cJSON_Print(response);
-            esp_websocket_client_send_text(client, json_str, strlen(json_str), portMAX_DELAY);
-            ESP_LOGI(TAG, "Enviando confirmación: %s", json_str);
-            
-            free(json_str);
-            cJSON_Delete(response);
+    // Los comandos con "seq" se confirman por secuencia; la confirmación
+    // (state_update) lleva la misma "seq" y sirve de ack. El "ip" de los
+    // comandos es la dirección del dispositivo destino: el relay lo usa para
+    // entregarlos y aquí se ignora
+    bool is_command = type == PROTO_MSG_TOGGLE_DEVICE || type == PROTO_MSG_SET_MANY || type == PROTO_MSG_RULES;
+    uint32_t seq_value;
+    int64_t seq = (is_command && proto_get_u32(data, len, "seq", &seq_value)) ? (int64_t)seq_value : -1;
+
+    if (seq >= 0 && !seq_window_accept(&command_window, (uint32_t)seq)) {
+        send_ack(client, (uint32_t)seq, true);
+        return;
+    }
+
+    uint32_t a, b;
+    bool replied = false;
+    switch (type) {
+        case PROTO_MSG_TOGGLE_DEVICE:
+            replied = handle_toggle(client, data, len, seq, received_us);
+            break;
+
+        case PROTO_MSG_SET_MANY:
+            // {"type":"set_many","ip":"192.168.1.6","mask":5,"states":1}: bit i = led_(i+1)
+            if (proto_get_u32(data, len, "mask", &a) && proto_get_u32(data, len, "states", &b)) {
+                uint32_t applied = a & outputs_all_mask(LED_COUNT);
+                uint32_t changed = update_led_states(applied, b);
+                send_combined_state(client, applied | changed, seq);
+                replied = true;
+            }
+            break;
+
+        case PROTO_MSG_STATE_ACK:
+            // El servidor confirma hasta qué versión del diario tiene el estado
+            if (proto_get_u32(data, len, "version", &a)) {
+                if (a <= state_journal_version() && (!server_acked || a > acked_version)) {
+                    acked_version = a;
+                    server_acked = true;
+                }
+            }
+            break;
+
+        case PROTO_MSG_RESYNC_REQUEST:
+            send_full_state(client);
+            break;
+
+        case PROTO_MSG_RULES: {
+            // La tabla de reglas es un array anidado: sólo aquí se usa cJSON
+            cJSON *root = cJSON_ParseWithLength(data, len);
+            if (root == NULL) {
+                ESP_LOGE(TAG, "Error parsing JSON");
+                break;
+            }
+            replied = handle_rules_message(client, root, seq);
+            cJSON_Delete(root);
+            break;
         }
+
+        case PROTO_MSG_CLOCK:
+            // Hora local del servidor en segundos desde medianoche
+            if (proto_get_u32(data, len, "seconds", &a)) {
+                rules_set_clock(a);
+            }
+            break;
+
+        default:
+            break;
     }
 
-    cJSON_Delete(root);
+    // Todo comando numerado recibe respuesta, aunque no se haya podido aplicar
+    if (seq >= 0 && !replied) {
+        send_ack(client, (uint32_t)seq, false);
+    }
 }
 
 void websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data) {
@@ -140,31 +591,35 @@ void websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t
     esp_websocket_client_handle_t client = (esp_websocket_client_handle_t)handler_args;
     
     switch (event_id) {
+        case WEBSOCKET_EVENT_BEFORE_CONNECT:
+            boot_timing_mark(BOOT_PHASE_WS_CONNECTING);
+            break;
+
         case WEBSOCKET_EVENT_CONNECTED:
+            link_counters.ws_connects++;
+            boot_timing_mark(BOOT_PHASE_WS_UPGRADED);
             ESP_LOGI(TAG, "Conectado al WebSocket Server");
-            // Enviar información de los dispositivos
-            vTaskDelay(pdMS_TO_TICKS(100));
-            send_device_info(client, "led_1");
-            vTaskDelay(pdMS_TO_TICKS(100));
-            send_device_info(client, "led_2");
-            vTaskDelay(pdMS_TO_TICKS(100));
-            send_device_info(client, "led_3");
+            // Enviar el estado de las salidas seguido, sin pausas
+            send_state_resync(client);
+            boot_timing_mark(BOOT_PHASE_FIRST_STATE);
+            boot_timing_log_summary();
             break;
 
         case WEBSOCKET_EVENT_DATA:
-            ESP_LOGI(TAG, "Mensaje recibido: %.*s", data->data_len, (char *)data->data_ptr);
-            char *message = malloc(data->data_len + 1);
-            memcpy(message, data->data_ptr, data->data_len);
-            message[data->data_len] = '\0';
-            handle_websocket_message(client, message);
-            free(message);
+            // El contenido completo sólo se compila con nivel verbose
+            DLOGD(TAG, "Mensaje recibido: %" PRIu32 " bytes, opcode %" PRIu32,
+                  (uint32_t)data->data_len, (uint32_t)data->op_code);
+            ESP_LOGV(TAG, "Mensaje recibido: %.*s", data->data_len, (char *)data->data_ptr);
+            handle_websocket_message(client, data->data_ptr, data->data_len);
             break;
 
         case WEBSOCKET_EVENT_DISCONNECTED:
+            link_counters.ws_disconnects++;
             ESP_LOGW(TAG, "Desconectado del WebSocket Server");
             break;
 
         case WEBSOCKET_EVENT_ERROR:
+            link_counters.ws_errors++;
             ESP_LOGE(TAG, "Error en WebSocket");
             break;
     }
@@ -187,6 +642,10 @@ void websocket_client_task(void *pvParameters)
     }
 
     esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, websocket_event_handler, (void *)client);
+    ws_task = xTaskGetCurrentTaskHandle();
+
+    // Cliente y transporte listos: esperar a tener IP para conectar
+    xEventGroupWaitBits(network_events, NETWORK_READY_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
 
     esp_err_t ret = esp_websocket_client_start(client);
     if (ret != ESP_OK) {
@@ -196,9 +655,33 @@ void websocket_client_task(void *pvParameters)
         return;
     }
 
+#if CONFIG_TELEMETRY_ENABLE
+    // Las tramas sólo se envían mientras el cliente está conectado
+    telemetry_register_default_sources();
+    ESP_ERROR_CHECK_WITHOUT_ABORT(telemetry_start(client));
+#endif
+
+    // Espera cambios de las reglas hasta que toca el siguiente mensaje de salud
+    const TickType_t health_period = pdMS_TO_TICKS(CONFIG_HEALTH_PERIOD_S * 1000);
+    TickType_t next_health = xTaskGetTickCount() + health_period;
     while (1)
     {
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = (int32_t)(next_health - now) > 0 ? next_health - now : 0;
+        uint32_t changed = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &changed, wait);
+
+        // Desconectado no se envía: el resync de la reconexión incluye estos cambios
+        bool connected = esp_websocket_client_is_connected(client);
+        if (changed && connected) {
+            send_combined_state(client, changed, -1);
+        }
+        if ((int32_t)(xTaskGetTickCount() - next_health) >= 0) {
+            next_health += health_period;
+            if (connected) {
+                send_health(client);
+            }
+        }
     }
 
     // Este código nunca se ejecutará en esta implementación
@@ -209,11 +692,9 @@ void websocket_client_task(void *pvParameters)
 
 void app_main(void)
 {
+    boot_timing_mark(BOOT_PHASE_APP_START);
     ESP_LOGI(TAG, "Iniciando aplicación...");
 
-    // Inicializar GPIOs
-    init_gpio();
-
     // Inicializar NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -221,15 +702,35 @@ void app_main(void)
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    ESP_ERROR_CHECK(dlog_init());
+
+    // Inicializar GPIOs con el estado guardado, antes de levantar el WiFi
+    state_lock = xSemaphoreCreateMutex();
+    ESP_ERROR_CHECK(state_store_init());
+    init_gpio();
+
+    // Reglas locales guardadas: funcionan aunque no haya conexión
+    ESP_ERROR_CHECK(rules_init(apply_rule_outputs, get_led_state));
+    rules_restore(LED_COUNT);
 
     // Inicializar la pila TCP/IP y el sistema de eventos
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
+#if !CONFIG_IDF_TARGET_LINUX
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, wifi_event_handler, NULL));
+#endif
+
+    // Iniciar la tarea del cliente WebSocket: crea el cliente mientras se conecta el WiFi
+    network_events = xEventGroupCreate();
+    xTaskCreate(websocket_client_task, "websocket_client", 8192, NULL, 5, NULL);
 
     // Inicializar y conectar al WiFi
     ESP_LOGI(TAG, "Conectando al WiFi...");
+#if CONFIG_IDF_TARGET_LINUX
     ESP_ERROR_CHECK(example_connect());
-
-    // Iniciar la tarea del cliente WebSocket
-    xTaskCreate(websocket_client_task, "websocket_client", 8192, NULL, 5, NULL);
+#else
+    ESP_ERROR_CHECK(wifi_link_connect());
+#endif
+    boot_timing_mark(BOOT_PHASE_IP_ACQUIRED);
+    xEventGroupSetBits(network_events, NETWORK_READY_BIT);
 }
@@ -0,0 +1,206 @@
+#include <string.h>
+#include "telemetry.h"
+#include "telemetry_ring.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Formato de trama binaria (little endian):
+//   cabecera: 'T' 'M' | versión u8 | nº de canales u8 | secuencia u32
+//   por canal: id u8 | reservado u8 | nº muestras u16 | periodo_us u32 |
+//              overflow u32 | dropped u32 | muestras (timestamp_us u32, valor i32)
+#define FRAME_MAGIC_0       'T'
+#define FRAME_MAGIC_1       'M'
+#define FRAME_VERSION       1
+#define FRAME_HEADER_SIZE   8
+#define BLOCK_HEADER_SIZE   16
+#define SAMPLE_SIZE         8
+#define BATCH_SAMPLES       CONFIG_TELEMETRY_BATCH_SAMPLES
+#define FRAME_MAX_SIZE      (FRAME_HEADER_SIZE + TELEMETRY_MAX_CHANNELS * \
+                             (BLOCK_HEADER_SIZE + BATCH_SAMPLES * SAMPLE_SIZE))
+
+static const char *TAG = "telemetry";
+
+typedef struct {
+    telemetry_source_t source;
+    telemetry_ring_t ring;
+    esp_timer_handle_t timer;
+    telemetry_channel_stats_t stats;
+} telemetry_channel_t;
+
+static telemetry_channel_t channels[TELEMETRY_MAX_CHANNELS];
+static size_t channel_count;
+static esp_websocket_client_handle_t ws_client;
+static TaskHandle_t upload_task;
+static uint32_t frame_seq;
+
+// Sólo la tarea de envío usa estos buffers
+static uint8_t frame_buf[FRAME_MAX_SIZE];
+static telemetry_sample_t batch[BATCH_SAMPLES];
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+    return p + 4;
+}
+
+// Callback de esp_timer: único productor del buffer de su canal
+static void sample_timer_cb(void *arg) {
+    telemetry_channel_t *ch = (telemetry_channel_t *)arg;
+    telemetry_sample_t sample;
+
+    if (!ch->source.read(ch->source.ctx, &sample.value)) {
+        ch->stats.read_errors++;
+        return;
+    }
+    sample.timestamp_us = (uint32_t)esp_timer_get_time();
+    ch->stats.sampled++;
+
+    if (!telemetry_ring_push(&ch->ring, sample)) {
+        ch->stats.overflow++;
+        return;
+    }
+    // Lote completo: despertar a la tarea de envío sin esperar al periodo
+    if (telemetry_ring_count(&ch->ring) == BATCH_SAMPLES && upload_task) {
+        xTaskNotifyGive(upload_task);
+    }
+}
+
+// Construye y envía una trama con hasta BATCH_SAMPLES muestras por canal.
+// Devuelve el número de muestras incluidas.
+static size_t send_frame(void) {
+    uint8_t *p = frame_buf + FRAME_HEADER_SIZE;
+    size_t total = 0;
+    uint8_t blocks = 0;
+    uint32_t frame_counts[TELEMETRY_MAX_CHANNELS] = { 0 };
+
+    for (size_t i = 0; i < channel_count; i++) {
+        telemetry_channel_t *ch = &channels[i];
+        size_t n = telemetry_ring_pop(&ch->ring, batch, BATCH_SAMPLES);
+        if (n == 0) {
+            continue;
+        }
+        *p++ = ch->source.channel_id;
+        *p++ = 0;
+        p = put_u16(p, (uint16_t)n);
+        p = put_u32(p, 1000000 / ch->source.sample_rate_hz);
+        p = put_u32(p, ch->stats.overflow);
+        p = put_u32(p, ch->stats.dropped);
+        for (size_t s = 0; s < n; s++) {
+            p = put_u32(p, batch[s].timestamp_us);
+            p = put_u32(p, (uint32_t)batch[s].value);
+        }
+        frame_counts[i] = n;
+        total += n;
+        blocks++;
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    frame_buf[0] = FRAME_MAGIC_0;
+    frame_buf[1] = FRAME_MAGIC_1;
+    frame_buf[2] = FRAME_VERSION;
+    frame_buf[3] = blocks;
+    put_u32(frame_buf + 4, frame_seq++);
+
+    int len = p - frame_buf;
+    bool sent = esp_websocket_client_is_connected(ws_client) &&
+                esp_websocket_client_send_bin(ws_client, (const char *)frame_buf, len,
+                                              pdMS_TO_TICKS(CONFIG_TELEMETRY_BATCH_MS)) == len;
+
+    for (size_t i = 0; i < channel_count; i++) {
+        if (sent) {
+            channels[i].stats.sent += frame_counts[i];
+        } else {
+            channels[i].stats.dropped += frame_counts[i];
+        }
+    }
+    return total;
+}
+
+static void telemetry_upload_task(void *arg) {
+    while (1) {
+        // Enviar cada CONFIG_TELEMETRY_BATCH_MS o antes si un canal completa el lote
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_TELEMETRY_BATCH_MS));
+
+        // Vaciar lo acumulado; cada trama lleva como mucho un lote por canal
+        while (send_frame() > 0) {
+        }
+    }
+}
+
+esp_err_t telemetry_register_source(const telemetry_source_t *source) {
+    if (source == NULL || source->read == NULL || source->sample_rate_hz == 0 ||
+        source->sample_rate_hz > 1000000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (channel_count >= TELEMETRY_MAX_CHANNELS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    telemetry_channel_t *ch = &channels[channel_count];
+    memset(ch, 0, sizeof(*ch));
+    ch->source = *source;
+    telemetry_ring_init(&ch->ring);
+
+    if (ch->source.init) {
+        esp_err_t err = ch->source.init(ch->source.ctx);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "No se pudo iniciar la fuente %s: %s", source->name, esp_err_to_name(err));
+            return err;
+        }
+    }
+
+    channel_count++;
+    return ESP_OK;
+}
+
+esp_err_t telemetry_start(esp_websocket_client_handle_t client) {
+    ws_client = client;
+
+    if (xTaskCreate(telemetry_upload_task, "telemetry", 3072, NULL, 4, &upload_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < channel_count; i++) {
+        telemetry_channel_t *ch = &channels[i];
+        const esp_timer_create_args_t args = {
+            .callback = sample_timer_cb,
+            .arg = ch,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = ch->source.name,
+        };
+        esp_err_t err = esp_timer_create(&args, &ch->timer);
+        if (err == ESP_OK) {
+            err = esp_timer_start_periodic(ch->timer, 1000000 / ch->source.sample_rate_hz);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error arrancando el canal %s: %s", ch->source.name, esp_err_to_name(err));
+            return err;
+        }
+        ESP_LOGI(TAG, "Canal %u (%s) a %" PRIu32 " Hz", ch->source.channel_id, ch->source.name,
+                 ch->source.sample_rate_hz);
+    }
+    return ESP_OK;
+}
+
+esp_err_t telemetry_get_stats(uint8_t channel_id, telemetry_channel_stats_t *stats) {
+    for (size_t i = 0; i < channel_count; i++) {
+        if (channels[i].source.channel_id == channel_id) {
+            *stats = channels[i].stats;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_websocket_client.h"
+
+// Número máximo de canales de telemetría registrables
+#define TELEMETRY_MAX_CHANNELS 4
+
+// Fuente de muestras de un canal. `read` se llama desde la tarea de esp_timer
+// a `sample_rate_hz`, así que no debe bloquear.
+typedef struct {
+    const char *name;
+    uint8_t channel_id;           // Identificador del canal en las tramas
+    uint32_t sample_rate_hz;
+    esp_err_t (*init)(void *ctx);
+    bool (*read)(void *ctx, int32_t *value);
+    void *ctx;
+} telemetry_source_t;
+
+typedef struct {
+    uint32_t sampled;      // Muestras leídas de la fuente
+    uint32_t read_errors;  // Lecturas fallidas de la fuente
+    uint32_t overflow;     // Muestras perdidas por buffer lleno
+    uint32_t dropped;      // Muestras extraídas pero no enviadas (envío fallido)
+    uint32_t sent;         // Muestras enviadas al servidor
+} telemetry_channel_stats_t;
+
+// Registra una fuente. Debe llamarse antes de telemetry_start().
+esp_err_t telemetry_register_source(const telemetry_source_t *source);
+
+// Registra las fuentes propias del target (ADC, temperatura, contadores o,
+// en linux, fuentes simuladas)
+void telemetry_register_default_sources(void);
+
+// Arranca el muestreo y la tarea que envía las tramas por `client`
+esp_err_t telemetry_start(esp_websocket_client_handle_t client);
+
+esp_err_t telemetry_get_stats(uint8_t channel_id, telemetry_channel_stats_t *stats);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Buffer circular sin bloqueos para un productor y un consumidor (SPSC).
+// El productor sólo escribe `head` y el consumidor sólo escribe `tail`;
+// los índices crecen sin límite y se enmascaran al acceder al buffer.
+
+#define TELEMETRY_RING_SIZE CONFIG_TELEMETRY_RING_SIZE
+
+_Static_assert((TELEMETRY_RING_SIZE & (TELEMETRY_RING_SIZE - 1)) == 0,
+               "CONFIG_TELEMETRY_RING_SIZE debe ser potencia de 2");
+
+typedef struct {
+    uint32_t timestamp_us;  // 32 bits bajos de esp_timer_get_time()
+    int32_t value;
+} telemetry_sample_t;
+
+typedef struct {
+    telemetry_sample_t buf[TELEMETRY_RING_SIZE];
+    atomic_uint_least32_t head;
+    atomic_uint_least32_t tail;
+} telemetry_ring_t;
+
+static inline void telemetry_ring_init(telemetry_ring_t *ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+}
+
+static inline uint32_t telemetry_ring_count(telemetry_ring_t *ring) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    return head - tail;
+}
+
+// Productor: devuelve false si el buffer está lleno (la muestra se descarta)
+static inline bool telemetry_ring_push(telemetry_ring_t *ring, telemetry_sample_t sample) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= TELEMETRY_RING_SIZE) {
+        return false;
+    }
+    ring->buf[head & (TELEMETRY_RING_SIZE - 1)] = sample;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+// Consumidor: copia hasta `max` muestras en `out` y devuelve cuántas copió
+static inline size_t telemetry_ring_pop(telemetry_ring_t *ring, telemetry_sample_t *out, size_t max) {
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t count = head - tail;
+    if (count > max) {
+        count = max;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = ring->buf[(tail + i) & (TELEMETRY_RING_SIZE - 1)];
+    }
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
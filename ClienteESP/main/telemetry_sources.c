@@ -0,0 +1,82 @@
+#include "telemetry.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_adc/adc_oneshot.h"
+#include "soc/soc_caps.h"
+#if SOC_TEMP_SENSOR_SUPPORTED
+#include "driver/temperature_sensor.h"
+#endif
+
+// Fuentes de telemetría del hardware real
+
+static const char *TAG = "telemetry_src";
+
+static adc_oneshot_unit_handle_t adc_handle;
+
+static esp_err_t adc_source_init(void *ctx) {
+    adc_oneshot_unit_init_cfg_t unit_cfg = {
+        .unit_id = ADC_UNIT_1,
+    };
+    esp_err_t err = adc_oneshot_new_unit(&unit_cfg, &adc_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    adc_oneshot_chan_cfg_t chan_cfg = {
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    return adc_oneshot_config_channel(adc_handle, CONFIG_TELEMETRY_ADC_CHANNEL, &chan_cfg);
+}
+
+static bool adc_source_read(void *ctx, int32_t *value) {
+    int raw;
+    if (adc_oneshot_read(adc_handle, CONFIG_TELEMETRY_ADC_CHANNEL, &raw) != ESP_OK) {
+        return false;
+    }
+    *value = raw;
+    return true;
+}
+
+#if SOC_TEMP_SENSOR_SUPPORTED
+static temperature_sensor_handle_t temp_handle;
+
+static esp_err_t temp_source_init(void *ctx) {
+    temperature_sensor_config_t cfg = TEMPERATURE_SENSOR_CONFIG_DEFAULT(-10, 80);
+    esp_err_t err = temperature_sensor_install(&cfg, &temp_handle);
+    if (err == ESP_OK) {
+        err = temperature_sensor_enable(temp_handle);
+    }
+    return err;
+}
+
+// Valor en centésimas de grado
+static bool temp_source_read(void *ctx, int32_t *value) {
+    float celsius;
+    if (temperature_sensor_get_celsius(temp_handle, &celsius) != ESP_OK) {
+        return false;
+    }
+    *value = (int32_t)(celsius * 100.0f);
+    return true;
+}
+#endif
+
+static bool heap_source_read(void *ctx, int32_t *value) {
+    *value = (int32_t)esp_get_free_heap_size();
+    return true;
+}
+
+void telemetry_register_default_sources(void) {
+    const telemetry_source_t sources[] = {
+        { "adc", 0, CONFIG_TELEMETRY_SAMPLE_RATE_HZ, adc_source_init, adc_source_read, NULL },
+#if SOC_TEMP_SENSOR_SUPPORTED
+        { "temperature", 1, 10, temp_source_init, temp_source_read, NULL },
+#endif
+        { "free_heap", 2, 10, NULL, heap_source_read, NULL },
+    };
+
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        if (telemetry_register_source(&sources[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Fuente %s no disponible", sources[i].name);
+        }
+    }
+}
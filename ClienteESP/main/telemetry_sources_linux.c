@@ -0,0 +1,34 @@
+#include <math.h>
+#include "telemetry.h"
+#include "esp_log.h"
+
+// Fuentes simuladas para el target linux: una senoidal y un contador
+
+static const char *TAG = "telemetry_src";
+
+static uint32_t sine_step;
+static uint32_t counter;
+
+static bool sine_source_read(void *ctx, int32_t *value) {
+    // Periodo de 100 muestras y amplitud de 2048, como un ADC de 12 bits
+    *value = 2048 + (int32_t)(2047.0 * sin(2.0 * M_PI * (sine_step++ % 100) / 100.0));
+    return true;
+}
+
+static bool counter_source_read(void *ctx, int32_t *value) {
+    *value = (int32_t)counter++;
+    return true;
+}
+
+void telemetry_register_default_sources(void) {
+    const telemetry_source_t sources[] = {
+        { "fake_adc", 0, CONFIG_TELEMETRY_SAMPLE_RATE_HZ, NULL, sine_source_read, NULL },
+        { "fake_counter", 2, 10, NULL, counter_source_read, NULL },
+    };
+
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        if (telemetry_register_source(&sources[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Fuente %s no disponible", sources[i].name);
+        }
+    }
+}
@@ -0,0 +1,204 @@
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "wifi_link.h"
+#include "esp_log.h"
+#include "esp_wifi.h"
+#include "esp_mac.h"
+#include "esp_netif.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+#define WIFI_NAMESPACE "wifi"
+#define WIFI_CACHE_KEY "cache"
+
+#define WIFI_GOT_IP_BIT BIT0
+
+// Reintentos con BSSID fijo antes de volver a escanear todos los canales
+#define FAST_RETRY_MAX 3
+
+static const char *TAG = "wifi_link";
+
+// Datos de la última conexión buena
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ip_info;
+    esp_ip4_addr_t dns;
+} wifi_cache_t;
+
+static esp_netif_t *sta_netif;
+static EventGroupHandle_t wifi_events;
+static wifi_cache_t cache;
+// Lo leen y cambian la tarea de eventos y la que llama a wifi_link_connect()
+static atomic_bool fast_path;
+static bool has_ip;
+static int fast_retries;
+static int64_t connect_start_us;
+static uint32_t time_to_ip_ms;
+
+#if CONFIG_WIFI_FAST_CONNECT
+static bool cache_load(wifi_cache_t *out) {
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*out);
+    esp_err_t err = nvs_get_blob(handle, WIFI_CACHE_KEY, out, &len);
+    nvs_close(handle);
+    return err == ESP_OK && len == sizeof(*out) && out->channel != 0;
+}
+
+static void cache_store(const wifi_cache_t *data) {
+    // Sólo se escribe si cambia algo: la mayoría de arranques repiten AP e IP
+    if (memcmp(data, &cache, sizeof(cache)) == 0) {
+        return;
+    }
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(handle, WIFI_CACHE_KEY, data, sizeof(*data)) == ESP_OK) {
+        nvs_commit(handle);
+        cache = *data;
+    }
+    nvs_close(handle);
+}
+#endif
+
+static void cache_clear(void) {
+    nvs_handle_t handle;
+    if (nvs_open(WIFI_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK) {
+        nvs_erase_key(handle, WIFI_CACHE_KEY);
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+    memset(&cache, 0, sizeof(cache));
+}
+
+static void apply_sta_config(bool use_cache) {
+    wifi_config_t config = {
+        .sta = {
+            .ssid = CONFIG_EXAMPLE_WIFI_SSID,
+            .password = CONFIG_EXAMPLE_WIFI_PASSWORD,
+            .scan_method = use_cache ? WIFI_FAST_SCAN : WIFI_ALL_CHANNEL_SCAN,
+            .sort_method = WIFI_CONNECT_AP_BY_SIGNAL,
+        },
+    };
+    if (use_cache) {
+        config.sta.bssid_set = true;
+        memcpy(config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+        config.sta.channel = cache.channel;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &config));
+}
+
+// Vuelve al escaneo completo con DHCP. Pueden pedirlo a la vez la tarea de
+// eventos (reintentos agotados) y wifi_link_connect() (tiempo agotado): sólo
+// lo hace quien desactiva la ruta rápida. Devuelve true en ese caso.
+static bool fall_back_to_scan(void) {
+    if (!atomic_exchange(&fast_path, false)) {
+        return false;
+    }
+    ESP_LOGW(TAG, "Ruta rápida fallida, escaneo completo con DHCP");
+    cache_clear();
+    esp_netif_dhcpc_start(sta_netif);
+    apply_sta_config(false);
+    return true;
+}
+
+static void wifi_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+#if CONFIG_WIFI_FAST_STATIC_IP
+        if (atomic_load(&fast_path)) {
+            // IP de la última concesión: evita la negociación DHCP
+            esp_netif_dhcpc_stop(sta_netif);
+            esp_netif_set_ip_info(sta_netif, &cache.ip_info);
+            esp_netif_dns_info_t dns = { .ip.u_addr.ip4 = cache.dns, .ip.type = ESP_IPADDR_TYPE_V4 };
+            esp_netif_set_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+        }
+#endif
+    } else if (base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        if (atomic_load(&fast_path) && ++fast_retries >= FAST_RETRY_MAX) {
+            fall_back_to_scan();
+        }
+        if (has_ip) {
+            // Reconexión: el tiempo hasta IP se mide desde la caída
+            has_ip = false;
+            connect_start_us = esp_timer_get_time();
+        }
+        esp_wifi_connect();
+    } else if (base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        time_to_ip_ms = (uint32_t)((esp_timer_get_time() - connect_start_us) / 1000);
+        fast_retries = 0;
+        has_ip = true;
+        ESP_LOGI(TAG, "IP obtenida en %" PRIu32 " ms (%s)", time_to_ip_ms,
+                 atomic_load(&fast_path) ? "ruta rápida" : "escaneo completo");
+
+#if CONFIG_WIFI_FAST_CONNECT
+        wifi_ap_record_t ap;
+        wifi_cache_t current = { 0 };
+        if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK &&
+            esp_netif_get_ip_info(sta_netif, &current.ip_info) == ESP_OK) {
+            esp_netif_dns_info_t dns;
+            memcpy(current.bssid, ap.bssid, sizeof(current.bssid));
+            current.channel = ap.primary;
+            if (esp_netif_get_dns_info(sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+                current.dns = dns.ip.u_addr.ip4;
+            }
+            cache_store(&current);
+        }
+#endif
+        xEventGroupSetBits(wifi_events, WIFI_GOT_IP_BIT);
+    }
+}
+
+esp_err_t wifi_link_connect(void) {
+    wifi_events = xEventGroupCreate();
+    sta_netif = esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t init = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&init));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, wifi_event_handler, NULL));
+
+    bool use_cache = false;
+#if CONFIG_WIFI_FAST_CONNECT
+    use_cache = cache_load(&cache);
+    if (use_cache) {
+        ESP_LOGI(TAG, "Ruta rápida: canal %d, BSSID " MACSTR, cache.channel, MAC2STR(cache.bssid));
+    }
+#endif
+    atomic_store(&fast_path, use_cache);
+
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    apply_sta_config(use_cache);
+    connect_start_us = esp_timer_get_time();
+    ESP_ERROR_CHECK(esp_wifi_start());
+
+#if CONFIG_WIFI_FAST_CONNECT
+    if (use_cache) {
+        EventBits_t bits = xEventGroupWaitBits(wifi_events, WIFI_GOT_IP_BIT, pdFALSE, pdTRUE,
+                                               pdMS_TO_TICKS(CONFIG_WIFI_FAST_CONNECT_TIMEOUT_MS));
+        if (!(bits & WIFI_GOT_IP_BIT) && fall_back_to_scan()) {
+            // El AP guardado no responde: la desconexión relanza la asociación
+            // ya con la configuración de escaneo completo
+            esp_wifi_disconnect();
+        }
+    }
+#endif
+
+    xEventGroupWaitBits(wifi_events, WIFI_GOT_IP_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+    return ESP_OK;
+}
+
+uint32_t wifi_link_time_to_ip_ms(void) {
+    return time_to_ip_ms;
+}
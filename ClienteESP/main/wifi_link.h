@@ -0,0 +1,13 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Conecta a la red WiFi configurada y espera a tener IP. Si hay datos de la
+// última conexión buena en NVS (BSSID, canal e IP) se intenta primero la ruta
+// rápida, sin escaneo ni DHCP; si no asocia a tiempo se vuelve al escaneo
+// completo con DHCP. Sustituye a example_connect() en el target real.
+esp_err_t wifi_link_connect(void);
+
+// Milisegundos que tardó la última conexión en obtener IP (se informa en el
+// mensaje de salud)
+uint32_t wifi_link_time_to_ip_ms(void);
@@ -0,0 +1,117 @@
+# SPDX-FileCopyrightText: 2024 Espressif Systems (Shanghai) CO LTD
+# SPDX-License-Identifier: Apache-2.0
+import json
+import logging
+import time
+from threading import Event
+from threading import Thread
+
+import pytest
+from pytest_embedded import Dut
+from SimpleWebSocketServer import SimpleWebSocketServer
+from SimpleWebSocketServer import WebSocket
+
+PORT = 8080
+COMMANDS = 500
+
+
+class CommandWindowServer(WebSocket):
+    """Hace de backend: envía COMMANDS toggles con como mucho `window` sin confirmar."""
+    window = 1
+    ready = Event()
+    done = Event()
+    # Como el backend, la numeración no se reinicia con la conexión: tras una
+    # reconexión el dispositivo descartaría como repetidas las seq ya usadas
+    seq = 0
+
+    def handleConnected(self):
+        self.acked = 0
+        self.outstanding = set()
+
+    def next_seq(self):
+        CommandWindowServer.seq += 1
+        return CommandWindowServer.seq
+
+    def start_run(self, window):
+        self.window = window
+        self.sent = 0
+        self.acked = 0
+        self.started = time.monotonic()
+        self.pump()
+
+    def pump(self):
+        while self.sent < COMMANDS and len(self.outstanding) < self.window:
+            seq = self.next_seq()
+            self.sent += 1
+            self.outstanding.add(seq)
+            state = 'on' if seq % 2 else 'off'
+            self.sendMessage(json.dumps({'type': 'toggle_device', 'identifier': 'led_1',
+                                         'state': state, 'seq': seq}))
+
+    def handleMessage(self):
+        if isinstance(self.data, (bytes, bytearray)):
+            return  # tramas binarias de telemetría
+        msg = json.loads(self.data)
+        if msg.get('type') == 'device_connected':
+            # Continuar desde la última seq que el dispositivo dice haber aplicado
+            last_seq = msg.get('last_seq')
+            if isinstance(last_seq, int) and last_seq > CommandWindowServer.seq:
+                CommandWindowServer.seq = last_seq
+            CommandWindowServer.ready.set()
+        seq = msg.get('seq')
+        if seq in self.outstanding:
+            self.outstanding.discard(seq)
+            self.acked += 1
+            if self.acked == COMMANDS:
+                self.elapsed = time.monotonic() - self.started
+                CommandWindowServer.done.set()
+            else:
+                self.pump()
+
+
+def serve(server, stop):
+    while not stop.is_set():
+        server.serveonce()
+
+
+@pytest.mark.linux
+@pytest.mark.host_test
+@pytest.mark.parametrize('config', ['linux'], indirect=True)
+def test_command_window_throughput(dut: Dut) -> None:
+    server = SimpleWebSocketServer('', PORT, CommandWindowServer)
+    stop = Event()
+    thread = Thread(target=serve, args=(server, stop))
+    thread.start()
+    try:
+        assert CommandWindowServer.ready.wait(30), 'el dispositivo no se conectó'
+        conn = next(iter(server.connections.values()))
+
+        rates = {}
+        for window in (1, 16):
+            CommandWindowServer.done.clear()
+            conn.start_run(window)
+            assert CommandWindowServer.done.wait(60), f'sin confirmaciones con ventana {window}'
+            rates[window] = COMMANDS / conn.elapsed
+            logging.info('Ventana %d: %.0f comandos/s por dispositivo', window, rates[window])
+
+        print('Comandos/s por dispositivo: ventana 1 = {:.0f}, ventana 16 = {:.0f}'.format(rates[1], rates[16]))
+        assert rates[16] >= rates[1]
+
+        # Un comando repetido (reenvío tras reconexión) se confirma sin aplicarse
+        conn.sendMessage(json.dumps({'type': 'toggle_device', 'identifier': 'led_1',
+                                     'state': 'on', 'seq': conn.seq}))
+        dut.expect('Comando repetido, seq={}'.format(conn.seq), timeout=10)
+
+        # set_many escribe un número fijo de registros sea cual sea el número de
+        # salidas: W1TS con las que se encienden y W1TC con las que se apagan
+        # (el primero deja un estado conocido, el segundo lo invierte)
+        conn.sendMessage(json.dumps({'type': 'set_many', 'mask': 7, 'states': 1}))
+        dut.expect('Estado combinado: mask=0x7 bits=0x1', timeout=10)
+        conn.sendMessage(json.dumps({'type': 'set_many', 'mask': 7, 'states': 6}))
+        dut.expect('outputs_write: 2 escrituras de registro', timeout=10)
+        conn.sendMessage(json.dumps({'type': 'set_many', 'mask': 7, 'states': 7}))
+        dut.expect('outputs_write: 1 escrituras de registro', timeout=10)
+    finally:
+        stop.set()
+        thread.join(10)
+        server.close()
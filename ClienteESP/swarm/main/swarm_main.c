@@ -0,0 +1,498 @@
+/*
+ * Simulador de enjambre de dispositivos (target linux).
+ *
+ * Arranca N dispositivos virtuales que hablan el mismo protocolo que el
+ * firmware (núcleo compartido de protocol/) contra un relay local, cada uno
+ * con su propia conexión esp_websocket_client y su identificador sim_<n>, y
+ * unos paneles virtuales que envían toggle_device con traza y miden la ida y
+ * vuelta hasta recibir la confirmación.
+ *
+ * Fases:
+ *  1. Avalancha: todos los dispositivos conectan a la vez.
+ *  2. Rampa: escalones de SWARM_RATE_START + k * SWARM_RATE_STEP comandos/s
+ *     hasta que el p99 o las pérdidas superan el umbral (saturación).
+ *
+ * Los valores de menuconfig se pueden cambiar al ejecutar con variables de
+ * entorno del mismo nombre: SWARM_DEVICES=1000 ./build/device_swarm.elf
+ */
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_websocket_client.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "protocol_c.h"
+
+static const char *TAG = "swarm";
+
+#define PROTO_BUF_SIZE 256
+#define INFLIGHT_SLOTS 65536       // Potencia de 2: comandos en vuelo indexados por traza
+#define MAX_SAMPLES 500000         // Muestras de ida y vuelta por escalón
+#define SIM_IP "127.0.0.1"
+
+typedef struct {
+    const char *uri;
+    int devices;
+    int dashboards;
+    int connect_timeout_s;
+    int telemetry_period_ms;
+    int rate_start;
+    int rate_step;
+    int rate_max;
+    int step_s;
+    int command_timeout_ms;
+    int saturation_p99_ms;
+    int saturation_loss_permille;
+} swarm_config_t;
+
+// Estado de un dispositivo virtual. Sólo lo toca la tarea de su cliente,
+// salvo los campos atómicos, que lee la tarea principal.
+typedef struct {
+    char identifier[16];
+    esp_websocket_client_handle_t client;
+    bool on;
+    uint32_t version;
+    uint32_t highest_seq;
+    bool seq_valid;
+    int64_t first_connect_us;      // Desde el inicio de la avalancha; -1 si no ha conectado
+    atomic_bool connected;
+} sim_device_t;
+
+// Comando en vuelo: `id` (traza) a 0 = ranura libre
+typedef struct {
+    int64_t sent_us;
+    atomic_uint id;
+} inflight_t;
+
+static swarm_config_t cfg;
+static sim_device_t *devices;
+static esp_websocket_client_handle_t *dashboards;
+static int64_t storm_start_us;
+
+static inflight_t inflight[INFLIGHT_SLOTS];
+static uint32_t *samples;
+static size_t sample_count;
+static SemaphoreHandle_t samples_lock;
+
+static atomic_int ws_connects, ws_disconnects, ws_errors, duplicates;
+
+static int env_int(const char *name, int fallback) {
+    const char *value = getenv(name);
+    return value && *value ? atoi(value) : fallback;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Percentil de un array ordenado
+static uint32_t percentile(const uint32_t *sorted, size_t n, unsigned pct) {
+    if (n == 0) {
+        return 0;
+    }
+    size_t i = n * pct / 100;
+    return sorted[i < n ? i : n - 1];
+}
+
+static bool is_text_frame(const esp_websocket_event_data_t *data) {
+    // Los mensajes del protocolo caben en una trama: se ignoran los fragmentos
+    return data->op_code == 0x1 && data->payload_offset == 0 && data->data_len == data->payload_len;
+}
+
+// --- Dispositivos virtuales ---
+
+static void device_send_state(sim_device_t *dev, const uint32_t *seq, const proto_trace_t *trace) {
+    char buf[PROTO_BUF_SIZE];
+    size_t len = proto_write_state_update(buf, sizeof(buf), dev->identifier, dev->on, SIM_IP,
+                                          &dev->version, seq, trace);
+    if (len) {
+        esp_websocket_client_send_text(dev->client, buf, len, portMAX_DELAY);
+    }
+}
+
+static void device_announce(sim_device_t *dev) {
+    char buf[PROTO_BUF_SIZE];
+    size_t len = proto_write_device_connected(buf, sizeof(buf), dev->identifier, SIM_IP,
+                                              dev->seq_valid ? &dev->highest_seq : NULL);
+    if (len) {
+        esp_websocket_client_send_text(dev->client, buf, len, portMAX_DELAY);
+    }
+    device_send_state(dev, NULL, NULL);
+}
+
+// Igual que el firmware: los comandos con "seq" ya aplicada se confirman sin repetirlos
+static bool device_accept_seq(sim_device_t *dev, uint32_t seq) {
+    if (dev->seq_valid && seq <= dev->highest_seq) {
+        char buf[64];
+        int n = snprintf(buf, sizeof(buf), "{\"type\":\"ack\",\"seq\":%" PRIu32 ",\"duplicate\":true}", seq);
+        esp_websocket_client_send_text(dev->client, buf, n, portMAX_DELAY);
+        atomic_fetch_add(&duplicates, 1);
+        return false;
+    }
+    dev->highest_seq = seq;
+    dev->seq_valid = true;
+    return true;
+}
+
+static void device_handle_message(sim_device_t *dev, const char *data, size_t len) {
+    int64_t received_us = esp_timer_get_time();
+    proto_msg_type_t type = proto_message_type(data, len);
+    uint32_t seq, a, b;
+    bool is_command = type == PROTO_MSG_TOGGLE_DEVICE || type == PROTO_MSG_SET_MANY;
+    bool has_seq = is_command && proto_get_u32(data, len, "seq", &seq);
+    if (has_seq && !device_accept_seq(dev, seq)) {
+        return;
+    }
+
+    switch (type) {
+        case PROTO_MSG_TOGGLE_DEVICE: {
+            const char *state;
+            size_t state_len;
+            dev->on = proto_get_string(data, len, "state", &state, &state_len) &&
+                      state_len == 2 && memcmp(state, "on", 2) == 0;
+            dev->version++;
+            int64_t applied_us = esp_timer_get_time();
+
+            proto_trace_t trace;
+            bool traced = proto_get_string(data, len, "trace", &trace.id, &trace.id_len);
+            if (traced) {
+                trace.apply_us = (uint32_t)(applied_us - received_us);
+                trace.total_us = (uint32_t)(esp_timer_get_time() - received_us);
+            }
+            device_send_state(dev, has_seq ? &seq : NULL, traced ? &trace : NULL);
+            break;
+        }
+
+        case PROTO_MSG_SET_MANY:
+            // Una sola salida por dispositivo virtual: bit 0
+            if (proto_get_u32(data, len, "mask", &a) && proto_get_u32(data, len, "states", &b) && (a & 1)) {
+                dev->on = b & 1;
+                dev->version++;
+            }
+            device_send_state(dev, has_seq ? &seq : NULL, NULL);
+            break;
+
+        case PROTO_MSG_RESYNC_REQUEST:
+            device_announce(dev);
+            break;
+
+        default:
+            // state_ack, clock, rules...: sin efecto en la simulación
+            break;
+    }
+}
+
+static void device_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    sim_device_t *dev = (sim_device_t *)arg;
+    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+
+    switch (event_id) {
+        case WEBSOCKET_EVENT_CONNECTED:
+            if (dev->first_connect_us < 0) {
+                dev->first_connect_us = esp_timer_get_time() - storm_start_us;
+            }
+            atomic_store(&dev->connected, true);
+            atomic_fetch_add(&ws_connects, 1);
+            device_announce(dev);
+            break;
+        case WEBSOCKET_EVENT_DISCONNECTED:
+        case WEBSOCKET_EVENT_CLOSED:
+            if (atomic_exchange(&dev->connected, false)) {
+                atomic_fetch_add(&ws_disconnects, 1);
+            }
+            break;
+        case WEBSOCKET_EVENT_ERROR:
+            atomic_fetch_add(&ws_errors, 1);
+            break;
+        case WEBSOCKET_EVENT_DATA:
+            if (is_text_frame(data)) {
+                device_handle_message(dev, data->data_ptr, data->data_len);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Mensajes de salud repartidos a lo largo del periodo, en rueda por los dispositivos
+static void telemetry_task(void *arg) {
+    int64_t interval_us = (int64_t)cfg.telemetry_period_ms * 1000 / cfg.devices;
+    int64_t next_us = esp_timer_get_time();
+    int next_device = 0;
+    char buf[PROTO_BUF_SIZE];
+
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        while (next_us <= now) {
+            sim_device_t *dev = &devices[next_device];
+            next_device = (next_device + 1) % cfg.devices;
+            next_us += interval_us > 0 ? interval_us : 1;
+            if (!atomic_load(&dev->connected)) {
+                continue;
+            }
+            int n = snprintf(buf, sizeof(buf),
+                             "{\"type\":\"health\",\"uptime_s\":%" PRIu32 ",\"heap_free\":%d,\"rssi\":%d}",
+                             (uint32_t)(now / 1000000), 150000 + rand() % 10000, -40 - rand() % 40);
+            esp_websocket_client_send_text(dev->client, buf, n, pdMS_TO_TICKS(100));
+        }
+        vTaskDelay(1);
+    }
+}
+
+// --- Paneles virtuales ---
+
+static void record_confirmation(const char *data, size_t len) {
+    const char *trace;
+    size_t trace_len;
+    if (proto_message_type(data, len) != PROTO_MSG_STATE_UPDATE ||
+        !proto_get_string(data, len, "trace", &trace, &trace_len) || trace_len < 2 || trace[0] != 's') {
+        return;
+    }
+    uint32_t id = 0;
+    for (size_t i = 1; i < trace_len; i++) {
+        id = id * 10 + (uint32_t)(trace[i] - '0');
+    }
+
+    // Todos los paneles reciben la confirmación: cuenta la primera en llegar
+    inflight_t *slot = &inflight[id & (INFLIGHT_SLOTS - 1)];
+    int64_t sent_us = slot->sent_us;
+    unsigned expected = id;
+    if (!atomic_compare_exchange_strong(&slot->id, &expected, 0)) {
+        return;
+    }
+    uint32_t rtt_us = (uint32_t)(esp_timer_get_time() - sent_us);
+    xSemaphoreTake(samples_lock, portMAX_DELAY);
+    if (sample_count < MAX_SAMPLES) {
+        samples[sample_count++] = rtt_us;
+    }
+    xSemaphoreGive(samples_lock);
+}
+
+static void dashboard_event_handler(void *arg, esp_event_base_t base, int32_t event_id, void *event_data) {
+    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+    if (event_id == WEBSOCKET_EVENT_DATA && is_text_frame(data)) {
+        record_confirmation(data->data_ptr, data->data_len);
+    }
+}
+
+static esp_websocket_client_handle_t start_client(const char *uri, esp_event_handler_t handler, void *arg) {
+    esp_websocket_client_config_t config = {
+        .uri = uri,
+        .reconnect_timeout_ms = 2000,
+        .network_timeout_ms = 10000,
+        .transport = WEBSOCKET_TRANSPORT_OVER_TCP,
+    };
+    esp_websocket_client_handle_t client = esp_websocket_client_init(&config);
+    if (client == NULL) {
+        return NULL;
+    }
+    esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, handler, arg);
+    if (esp_websocket_client_start(client) != ESP_OK) {
+        esp_websocket_client_destroy(client);
+        return NULL;
+    }
+    return client;
+}
+
+// --- Fases ---
+
+static int connected_devices(void) {
+    int count = 0;
+    for (int i = 0; i < cfg.devices; i++) {
+        count += atomic_load(&devices[i].connected);
+    }
+    return count;
+}
+
+static void connect_storm(void) {
+    char uri[160];
+    storm_start_us = esp_timer_get_time();
+    for (int i = 0; i < cfg.devices; i++) {
+        sim_device_t *dev = &devices[i];
+        snprintf(dev->identifier, sizeof(dev->identifier), "sim_%d", i + 1);
+        dev->first_connect_us = -1;
+        // El relay distingue los dispositivos de una misma IP por este parámetro
+        snprintf(uri, sizeof(uri), "%s/?device=%s", cfg.uri, dev->identifier);
+        dev->client = start_client(uri, device_event_handler, dev);
+        if (dev->client == NULL) {
+            ESP_LOGE(TAG, "No se pudo crear el cliente de %s", dev->identifier);
+        }
+    }
+
+    int64_t deadline = storm_start_us + (int64_t)cfg.connect_timeout_s * 1000000;
+    int connected = 0;
+    while ((connected = connected_devices()) < cfg.devices && esp_timer_get_time() < deadline) {
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+    double elapsed_s = (esp_timer_get_time() - storm_start_us) / 1e6;
+
+    uint32_t *latencies = malloc(sizeof(uint32_t) * cfg.devices);
+    size_t n = 0;
+    for (int i = 0; i < cfg.devices; i++) {
+        if (devices[i].first_connect_us >= 0) {
+            latencies[n++] = (uint32_t)devices[i].first_connect_us;
+        }
+    }
+    qsort(latencies, n, sizeof(uint32_t), compare_u32);
+    printf("\nAvalancha de conexiones: %d/%d conectados en %.2f s\n", connected, cfg.devices, elapsed_s);
+    printf("  conexión p50 %.1f ms, p99 %.1f ms, máx %.1f ms; errores %d, desconexiones %d\n",
+           percentile(latencies, n, 50) / 1000.0, percentile(latencies, n, 99) / 1000.0,
+           n ? latencies[n - 1] / 1000.0 : 0.0, atomic_load(&ws_errors), atomic_load(&ws_disconnects));
+    free(latencies);
+}
+
+// Un escalón de la rampa. Devuelve true si el relay está saturado.
+static bool run_step(int rate, uint32_t *next_trace) {
+    xSemaphoreTake(samples_lock, portMAX_DELAY);
+    sample_count = 0;
+    xSemaphoreGive(samples_lock);
+    int disconnects_before = atomic_load(&ws_disconnects);
+
+    char buf[PROTO_BUF_SIZE];
+    int64_t start_us = esp_timer_get_time();
+    int64_t end_us = start_us + (int64_t)cfg.step_s * 1000000;
+    uint64_t sent = 0;
+    size_t lost = 0;
+    while (esp_timer_get_time() < end_us) {
+        // Los comandos que tocan hasta ahora; con más de uno por tick se envían juntos
+        uint64_t due = (uint64_t)(esp_timer_get_time() - start_us) * rate / 1000000;
+        for (; sent < due; sent++) {
+            // Preferir dispositivos conectados: los comandos a uno caído esperan en el relay
+            sim_device_t *dev = &devices[rand() % cfg.devices];
+            for (int tries = 0; tries < 8 && !atomic_load(&dev->connected); tries++) {
+                dev = &devices[rand() % cfg.devices];
+            }
+            uint32_t id = (*next_trace)++;
+            if (id == 0) {
+                id = (*next_trace)++;
+            }
+            // Con más de INFLIGHT_SLOTS comandos en vuelo la ranura aún puede tener
+            // uno sin confirmar: se da por perdido. Se libera antes de escribir
+            // sent_us para que una confirmación tardía no lo lea a medias.
+            inflight_t *slot = &inflight[id & (INFLIGHT_SLOTS - 1)];
+            if (atomic_exchange(&slot->id, 0) != 0) {
+                lost++;
+            }
+            slot->sent_us = esp_timer_get_time();
+            atomic_store(&slot->id, id);
+            int n = snprintf(buf, sizeof(buf),
+                             "{\"type\":\"toggle_device\",\"identifier\":\"%s\",\"state\":\"%s\",\"trace\":\"s%" PRIu32 "\"}",
+                             dev->identifier, (id & 1) ? "on" : "off", id);
+            esp_websocket_client_send_text(dashboards[id % cfg.dashboards], buf, n, pdMS_TO_TICKS(100));
+        }
+        vTaskDelay(1);
+    }
+
+    // Esperar a las últimas confirmaciones; lo que quede en vuelo se pierde
+    vTaskDelay(pdMS_TO_TICKS(cfg.command_timeout_ms));
+    for (size_t i = 0; i < INFLIGHT_SLOTS; i++) {
+        if (atomic_exchange(&inflight[i].id, 0) != 0) {
+            lost++;
+        }
+    }
+
+    xSemaphoreTake(samples_lock, portMAX_DELAY);
+    size_t n = sample_count;
+    qsort(samples, n, sizeof(uint32_t), compare_u32);
+    uint32_t p50 = percentile(samples, n, 50), p90 = percentile(samples, n, 90);
+    uint32_t p99 = percentile(samples, n, 99), max = n ? samples[n - 1] : 0;
+    xSemaphoreGive(samples_lock);
+
+    int dropped = atomic_load(&ws_disconnects) - disconnects_before;
+    printf("%7d %9" PRIu64 " %9zu %7zu %9.1f %9.1f %9.1f %9.1f %7d\n", rate, sent, n, lost,
+           p50 / 1000.0, p90 / 1000.0, p99 / 1000.0, max / 1000.0, dropped);
+
+    return p99 > (uint32_t)cfg.saturation_p99_ms * 1000 ||
+           (sent > 0 && lost * 1000 > sent * (uint64_t)cfg.saturation_loss_permille);
+}
+
+static void command_ramp(void) {
+    printf("\nRampa de comandos (%d paneles, %d s por escalón)\n", cfg.dashboards, cfg.step_s);
+    printf("%7s %9s %9s %7s %9s %9s %9s %9s %7s\n",
+           "cmd/s", "enviados", "confirm.", "perdid.", "p50 ms", "p90 ms", "p99 ms", "máx ms", "descon.");
+
+    uint32_t next_trace = 1;
+    int last_ok = 0;
+    for (int rate = cfg.rate_start; rate <= cfg.rate_max; rate += cfg.rate_step) {
+        if (run_step(rate, &next_trace)) {
+            printf("\nSaturación a %d cmd/s (p99 > %d ms o pérdidas > %d por mil); último escalón sano: %d cmd/s\n",
+                   rate, cfg.saturation_p99_ms, cfg.saturation_loss_permille, last_ok);
+            return;
+        }
+        last_ok = rate;
+        if (cfg.rate_step <= 0) {
+            break;
+        }
+    }
+    printf("\nSin saturación hasta %d cmd/s\n", last_ok);
+}
+
+void app_main(void)
+{
+    cfg = (swarm_config_t){
+        .uri = getenv("SWARM_URI") ? getenv("SWARM_URI") : CONFIG_SWARM_URI,
+        .devices = env_int("SWARM_DEVICES", CONFIG_SWARM_DEVICES),
+        .dashboards = env_int("SWARM_DASHBOARDS", CONFIG_SWARM_DASHBOARDS),
+        .connect_timeout_s = env_int("SWARM_CONNECT_TIMEOUT_S", CONFIG_SWARM_CONNECT_TIMEOUT_S),
+        .telemetry_period_ms = env_int("SWARM_TELEMETRY_PERIOD_MS", CONFIG_SWARM_TELEMETRY_PERIOD_MS),
+        .rate_start = env_int("SWARM_RATE_START", CONFIG_SWARM_RATE_START),
+        .rate_step = env_int("SWARM_RATE_STEP", CONFIG_SWARM_RATE_STEP),
+        .rate_max = env_int("SWARM_RATE_MAX", CONFIG_SWARM_RATE_MAX),
+        .step_s = env_int("SWARM_STEP_S", CONFIG_SWARM_STEP_S),
+        .command_timeout_ms = env_int("SWARM_COMMAND_TIMEOUT_MS", CONFIG_SWARM_COMMAND_TIMEOUT_MS),
+        .saturation_p99_ms = env_int("SWARM_SATURATION_P99_MS", CONFIG_SWARM_SATURATION_P99_MS),
+        .saturation_loss_permille = env_int("SWARM_SATURATION_LOSS_PERMILLE", CONFIG_SWARM_SATURATION_LOSS_PERMILLE),
+    };
+    if (cfg.devices < 1 || cfg.dashboards < 1) {
+        ESP_LOGE(TAG, "Hacen falta al menos un dispositivo y un panel");
+        exit(1);
+    }
+    ESP_LOGI(TAG, "Relay %s: %d dispositivos, %d paneles", cfg.uri, cfg.devices, cfg.dashboards);
+    esp_log_level_set("websocket_client", ESP_LOG_WARN);
+    esp_log_level_set("transport_ws", ESP_LOG_WARN);
+
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    devices = calloc(cfg.devices, sizeof(sim_device_t));
+    dashboards = calloc(cfg.dashboards, sizeof(esp_websocket_client_handle_t));
+    samples = malloc(sizeof(uint32_t) * MAX_SAMPLES);
+    samples_lock = xSemaphoreCreateMutex();
+    if (!devices || !dashboards || !samples || !samples_lock) {
+        ESP_LOGE(TAG, "Sin memoria");
+        exit(1);
+    }
+
+    // Los paneles primero: reciben los anuncios de la avalancha
+    for (int i = 0; i < cfg.dashboards; i++) {
+        dashboards[i] = start_client(cfg.uri, dashboard_event_handler, NULL);
+        if (dashboards[i] == NULL) {
+            ESP_LOGE(TAG, "No se pudo crear el panel %d", i);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < 100 && !esp_websocket_client_is_connected(dashboards[cfg.dashboards - 1]); i++) {
+        vTaskDelay(pdMS_TO_TICKS(50));
+    }
+
+    connect_storm();
+    if (cfg.telemetry_period_ms > 0) {
+        xTaskCreate(telemetry_task, "telemetry", 4096, NULL, 4, NULL);
+    }
+    command_ramp();
+
+    printf("\nConexiones %d, desconexiones %d, errores %d, comandos repetidos %d\n",
+           atomic_load(&ws_connects), atomic_load(&ws_disconnects), atomic_load(&ws_errors),
+           atomic_load(&duplicates));
+    fflush(stdout);
+    exit(0);
+}
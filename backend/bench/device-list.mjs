@@ -0,0 +1,143 @@
+// GET /api/devices con 100k dispositivos: recorrido paginado, sondeos con
+// If-None-Match y escrituras concurrentes mientras se sondea.
+//
+// Crea BENCH_DEVICES filas con ip "bench-<n>" en la base de datos configurada
+// (src/config/db.ts) y las borra al terminar. Usar una base de datos de
+// pruebas con init.sql aplicado y el backend arrancado:
+//
+//   npm run build && npm start &
+//   npm run bench:devices
+//
+// Variables: BENCH_HTTP (http://127.0.0.1:3000), BENCH_DEVICES (100000),
+// BENCH_POLLS (1000), BENCH_WRITERS (8), BENCH_SECONDS (10).
+
+import { createRequire } from 'module';
+
+const require = createRequire(import.meta.url);
+const { Pool } = require('pg');
+const { dbConfig } = require('../dist/config/db.js');
+
+const HTTP = process.env.BENCH_HTTP ?? 'http://127.0.0.1:3000';
+const DEVICES = Number(process.env.BENCH_DEVICES) || 100000;
+const POLLS = Number(process.env.BENCH_POLLS) || 1000;
+const WRITERS = Number(process.env.BENCH_WRITERS) || 8;
+const SECONDS = Number(process.env.BENCH_SECONDS) || 10;
+const PAGE = 5000;
+// Columnas que no incluyen data: las escrituras de salud no deben invalidarlas
+const CORE_FIELDS = 'id,name,type,ip,status';
+
+const pool = new Pool({ ...dbConfig, max: WRITERS + 2 });
+
+function percentile(sorted, q) {
+  return sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))] : 0;
+}
+
+function ms(start) {
+  return Number(process.hrtime.bigint() - start) / 1e6;
+}
+
+async function seed() {
+  await pool.query(`DELETE FROM dispositivos_conectados WHERE ip LIKE 'bench-%'`);
+  const start = process.hrtime.bigint();
+  await pool.query(
+    `INSERT INTO dispositivos_conectados (name, type, ip, status, data)
+     SELECT 'bench ' || n, 'led', 'bench-' || n, 'offline', jsonb_build_object('state', 'off')
+     FROM generate_series(1, $1) AS n`,
+    [DEVICES],
+  );
+  await pool.query('ANALYZE dispositivos_conectados');
+  console.log(`Alta de ${DEVICES} dispositivos: ${ms(start).toFixed(0)} ms`);
+}
+
+// Recorre el listado siguiendo la cabecera Link
+async function walk(fields) {
+  const start = process.hrtime.bigint();
+  let url = `${HTTP}/api/devices?limit=${PAGE}${fields ? `&fields=${fields}` : ''}`;
+  let rows = 0;
+  let bytes = 0;
+  let pages = 0;
+  while (url) {
+    const res = await fetch(url);
+    const body = await res.text();
+    bytes += body.length;
+    rows += JSON.parse(body).length;
+    pages++;
+    const next = /<([^>]+)>; rel="next"/.exec(res.headers.get('link') ?? '');
+    url = next ? new URL(next[1], HTTP).toString() : '';
+  }
+  const elapsed = ms(start);
+  console.log(
+    `Listado ${fields ?? 'completo'}: ${rows} filas en ${pages} páginas, ` +
+      `${(bytes / 1e6).toFixed(1)} MB, ${elapsed.toFixed(0)} ms`,
+  );
+}
+
+// Sondea la primera página con su ETag; devuelve latencias y respuestas 304
+async function poll(fields, count, stop = () => false) {
+  const url = `${HTTP}/api/devices?limit=${PAGE}&fields=${fields}`;
+  let etag = (await fetch(url)).headers.get('etag');
+  const latencies = [];
+  let notModified = 0;
+  for (let i = 0; i < count && !stop(); i++) {
+    const start = process.hrtime.bigint();
+    const res = await fetch(url, { headers: { 'If-None-Match': etag } });
+    await res.arrayBuffer();
+    latencies.push(ms(start));
+    if (res.status === 304) {
+      notModified++;
+    } else {
+      etag = res.headers.get('etag');
+    }
+  }
+  latencies.sort((a, b) => a - b);
+  return { latencies, notModified };
+}
+
+function report(label, { latencies, notModified }) {
+  console.log(
+    `${label}: ${latencies.length} sondeos, ${notModified} con 304, ` +
+      `p50 ${percentile(latencies, 0.5).toFixed(2)} ms, p99 ${percentile(latencies, 0.99).toFixed(2)} ms`,
+  );
+}
+
+// WRITERS conexiones escribiendo en filas distintas durante SECONDS segundos
+async function write(kind, stopAt) {
+  let writes = 0;
+  const writer = async w => {
+    for (let i = 0; Date.now() < stopAt; i++) {
+      const ip = `bench-${1 + ((i * WRITERS + w) % DEVICES)}`;
+      if (kind === 'status') {
+        await pool.query('UPDATE dispositivos_conectados SET status = $1 WHERE ip = $2', [i % 2 ? 'online' : 'offline', ip]);
+      } else {
+        await pool.query(
+          `UPDATE dispositivos_conectados SET data = jsonb_set(COALESCE(data, '{}'), '{health}', $1) WHERE ip = $2`,
+          [JSON.stringify({ heap_free: i }), ip],
+        );
+      }
+      writes++;
+    }
+  };
+  await Promise.all(Array.from({ length: WRITERS }, (_, w) => writer(w)));
+  return writes;
+}
+
+async function writeWhilePolling(kind) {
+  const stopAt = Date.now() + SECONDS * 1000;
+  const [writes, polled] = await Promise.all([write(kind, stopAt), poll(CORE_FIELDS, Infinity, () => Date.now() >= stopAt)]);
+  console.log(`Escrituras de ${kind} (${WRITERS} conexiones): ${(writes / SECONDS).toFixed(0)}/s`);
+  report(`  sondeos de ${CORE_FIELDS} mientras tanto`, polled);
+}
+
+try {
+  await seed();
+  await walk();
+  await walk(CORE_FIELDS);
+  report('Sin escrituras', await poll(CORE_FIELDS, POLLS));
+  // Salud: sólo cambia data, la versión de CORE_FIELDS no sube
+  await writeWhilePolling('health');
+  // Estado de conexión: cada escritura cambia la versión
+  await writeWhilePolling('status');
+} finally {
+  await pool.query(`DELETE FROM dispositivos_conectados WHERE ip LIKE 'bench-%'`);
+  await pool.end();
+}
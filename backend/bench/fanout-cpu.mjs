@@ -0,0 +1,119 @@
+// CPU del relay al repartir mensajes a muchos paneles, sin Postgres.
+//
+// El proceso principal hace de relay: recibe BENCH_DASHBOARDS conexiones y
+// reparte BENCH_MESSAGES state_update a todas. Los paneles están en un
+// proceso hijo, para que su CPU no cuente. Se compara:
+//   ws.send:  ws.send(json) directo, sin cola (referencia)
+//   string:   sendQueued(ws, json): cada envío vuelve a codificar el texto
+//   prepared: sendQueued con un PreparedMessage compartido, como
+//             WebSocketService.deliver
+//
+//   npm run build && npm run bench:fanout
+
+import { fork } from 'child_process';
+import http from 'http';
+import { createRequire } from 'module';
+import WebSocket, { WebSocketServer } from 'ws';
+
+const require = createRequire(import.meta.url);
+const { PreparedMessage, sendQueued } = require('../dist/services/send-queue.js');
+
+const DASHBOARDS = Number(process.env.BENCH_DASHBOARDS) || 1000;
+const MESSAGES = Number(process.env.BENCH_MESSAGES) || 2000;
+// Mensajes por vuelta del bucle de eventos; entre vueltas ws escribe al socket
+const BATCH = 20;
+const PORT = Number(process.env.BENCH_PORT) || 8090;
+
+if (process.argv[2] === 'dashboards') {
+  // Proceso hijo: abre los paneles y avisa al llegar todos los mensajes
+  let received = 0;
+  let expected = Infinity;
+  const sockets = [];
+  process.on('message', message => {
+    if (message.expect !== undefined) {
+      expected = message.expect;
+      if (received >= expected) {
+        process.send({ done: received });
+      }
+    }
+    if (message.exit) {
+      sockets.forEach(ws => ws.terminate());
+      process.exit(0);
+    }
+  });
+  for (let i = 0; i < DASHBOARDS; i++) {
+    const ws = new WebSocket(`ws://127.0.0.1:${PORT}`);
+    ws.on('message', () => {
+      if (++received === expected) {
+        process.send({ done: received });
+      }
+    });
+    await new Promise((resolve, reject) => {
+      ws.once('open', resolve);
+      ws.once('error', reject);
+    });
+    sockets.push(ws);
+  }
+  process.send({ ready: true });
+} else {
+  const server = http.createServer();
+  const wss = new WebSocketServer({ server });
+  await new Promise(resolve => server.listen(PORT, '127.0.0.1', resolve));
+
+  const child = fork(new URL(import.meta.url).pathname, ['dashboards'], { env: process.env });
+  const fromChild = () => new Promise(resolve => child.once('message', resolve));
+  await fromChild();
+  const clients = [...wss.clients];
+  console.log(`${clients.length} paneles, ${MESSAGES} mensajes por medida`);
+
+  const modes = {
+    'ws.send': json => clients.forEach(ws => ws.send(json)),
+    string: json => clients.forEach(ws => sendQueued(ws, json, { type: 'state_update' })),
+    prepared: json => {
+      const message = new PreparedMessage(json);
+      clients.forEach(ws => sendQueued(ws, message, { type: 'state_update' }));
+    },
+  };
+
+  const json = i =>
+    JSON.stringify({ type: 'state_update', identifier: `led_${i % 3}`, state: i % 2 ? 'on' : 'off', ip: '192.168.1.6', version: i });
+
+  let delivered = 0;
+  // Reparte `messages` mensajes y devuelve la CPU usada (ms) y el tiempo (s)
+  const measure = async (deliver, messages) => {
+    delivered += messages * clients.length;
+    const done = fromChild();
+    child.send({ expect: delivered });
+
+    const cpu = process.cpuUsage();
+    const t0 = process.hrtime.bigint();
+    for (let i = 0; i < messages; i += BATCH) {
+      for (let j = i; j < Math.min(i + BATCH, messages); j++) {
+        deliver(json(j));
+      }
+      await new Promise(resolve => setImmediate(resolve));
+    }
+    await done;
+    const used = process.cpuUsage(cpu);
+    return { cpuMs: (used.user + used.system) / 1000, elapsed: Number(process.hrtime.bigint() - t0) / 1e9 };
+  };
+
+  // Calentamiento del JIT con los dos modos antes de medir
+  for (const deliver of Object.values(modes)) {
+    await measure(deliver, Math.ceil(MESSAGES / 10));
+  }
+
+  for (const [name, deliver] of Object.entries(modes)) {
+    const { cpuMs, elapsed } = await measure(deliver, MESSAGES);
+    const sends = MESSAGES * clients.length;
+    console.log(
+      `${name.padEnd(9)} CPU ${cpuMs.toFixed(0).padStart(6)} ms  ` +
+        `${((cpuMs * 1e6) / sends).toFixed(0).padStart(5)} ns/envío  ` +
+        `${(sends / elapsed / 1000).toFixed(0).padStart(6)}k envíos/s`,
+    );
+  }
+
+  child.send({ exit: true });
+  wss.close();
+  server.close();
+}
@@ -0,0 +1,161 @@
+// Rendimiento del relay con 1..N procesos (RELAY_WORKERS) en esta máquina.
+//
+// Arranca dist/app.js con cada número de procesos, conecta dispositivos
+// simulados que envían state_update sin pausa y paneles suscritos a todo, y
+// mide los mensajes por segundo que llegan a los paneles. Los paneles y los
+// dispositivos quedan repartidos entre procesos, así que casi todo el tráfico
+// cruza el bus de Postgres (LISTEN/NOTIFY).
+//
+// Requiere Postgres con el esquema de src/db (ver src/config/db.ts) y el
+// backend compilado:
+//
+//   npm run build && npm run bench:relay
+//
+// Variables: BENCH_WORKERS (lista, por defecto 1,2,4.. hasta los núcleos),
+// BENCH_DEVICES, BENCH_DASHBOARDS, BENCH_SECONDS, BENCH_MIN_EFFICIENCY (si se
+// da, termina con error si la eficiencia con más procesos queda por debajo).
+
+import { spawn } from 'child_process';
+import { cpus } from 'os';
+import WebSocket from 'ws';
+
+const URL = process.env.BENCH_URL ?? 'ws://127.0.0.1:80';
+const DEVICES = Number(process.env.BENCH_DEVICES) || 64;
+const DASHBOARDS = Number(process.env.BENCH_DASHBOARDS) || 8;
+const SECONDS = Number(process.env.BENCH_SECONDS) || 10;
+const WARMUP_S = 2;
+const MIN_EFFICIENCY = Number(process.env.BENCH_MIN_EFFICIENCY) || 0;
+// Cada dispositivo deja de enviar mientras tenga esto sin escribir en el socket
+const DEVICE_BACKLOG = 64 * 1024;
+
+function defaultWorkers() {
+  const list = [];
+  for (let n = 1; n < cpus().length; n *= 2) {
+    list.push(n);
+  }
+  list.push(cpus().length);
+  return list;
+}
+
+const WORKERS = process.env.BENCH_WORKERS
+  ? process.env.BENCH_WORKERS.split(',').map(Number)
+  : defaultWorkers();
+
+const sleep = ms => new Promise(resolve => setTimeout(resolve, ms));
+
+function open(url) {
+  return new Promise((resolve, reject) => {
+    const ws = new WebSocket(url);
+    ws.once('open', () => resolve(ws));
+    ws.once('error', reject);
+  });
+}
+
+async function startRelay(workers) {
+  const relay = spawn(process.execPath, ['dist/app.js'], {
+    env: { ...process.env, RELAY_WORKERS: String(workers), RELAY_SIMULATED_DEVICES: '1' },
+    stdio: 'ignore',
+  });
+  // Espera a que todos los procesos acepten conexiones
+  for (let i = 0; i < 100; i++) {
+    try {
+      (await open(URL)).close();
+      await sleep(1000 + workers * 200);
+      return relay;
+    } catch {
+      await sleep(200);
+    }
+  }
+  relay.kill('SIGKILL');
+  throw new Error('el relay no ha arrancado');
+}
+
+function stopRelay(relay) {
+  return new Promise(resolve => {
+    relay.once('exit', resolve);
+    relay.kill('SIGTERM');
+  });
+}
+
+async function run(workers) {
+  const relay = await startRelay(workers);
+  const counts = { sent: 0, delivered: 0 };
+  const sockets = [];
+  let running = true;
+
+  try {
+    for (let i = 0; i < DASHBOARDS; i++) {
+      const ws = await open(URL);
+      ws.on('message', data => {
+        if (data.toString().includes('"state_update"')) {
+          counts.delivered++;
+        }
+      });
+      sockets.push(ws);
+    }
+
+    for (let i = 0; i < DEVICES; i++) {
+      const identifier = `sim_${i}`;
+      const ws = await open(`${URL}/?device=${identifier}`);
+      ws.send(JSON.stringify({ type: 'device_connected', identifier, ip: '127.0.0.1' }));
+      sockets.push(ws);
+
+      let on = false;
+      const canSend = () => running && ws.readyState === WebSocket.OPEN && ws.bufferedAmount < DEVICE_BACKLOG;
+      const pump = () => {
+        // Por tandas, para no acaparar el bucle de eventos del cliente
+        for (let n = 0; n < 32 && canSend(); n++) {
+          on = !on;
+          ws.send(JSON.stringify({ type: 'state_update', identifier, state: on ? 'on' : 'off', ip: '127.0.0.1' }));
+          counts.sent++;
+        }
+        if (running) {
+          setTimeout(pump, 1);
+        }
+      };
+      setTimeout(pump, 0);
+    }
+
+    await sleep(WARMUP_S * 1000);
+    const start = { ...counts };
+    const t0 = process.hrtime.bigint();
+    await sleep(SECONDS * 1000);
+    const elapsed = Number(process.hrtime.bigint() - t0) / 1e9;
+
+    return {
+      workers,
+      sent: (counts.sent - start.sent) / elapsed,
+      // Mensajes distintos entregados: cada uno llega a todos los paneles
+      relayed: (counts.delivered - start.delivered) / elapsed / DASHBOARDS,
+    };
+  } finally {
+    running = false;
+    for (const ws of sockets) {
+      ws.terminate();
+    }
+    await stopRelay(relay);
+  }
+}
+
+const results = [];
+for (const workers of WORKERS) {
+  results.push(await run(workers));
+}
+
+const base = results[0].relayed / results[0].workers;
+console.log(`${DEVICES} dispositivos, ${DASHBOARDS} paneles, ${SECONDS} s por medida, ${cpus().length} núcleos`);
+console.log('procesos  enviados/s  retransmitidos/s  aceleración  eficiencia');
+for (const r of results) {
+  const speedup = r.relayed / results[0].relayed;
+  const efficiency = r.relayed / r.workers / base;
+  console.log(
+    `${String(r.workers).padStart(8)}  ${r.sent.toFixed(0).padStart(10)}  ${r.relayed.toFixed(0).padStart(16)}` +
+      `  ${speedup.toFixed(2).padStart(11)}  ${(efficiency * 100).toFixed(0).padStart(9)}%`,
+  );
+}
+
+const last = results[results.length - 1];
+if (MIN_EFFICIENCY && last.relayed / last.workers / base < MIN_EFFICIENCY) {
+  console.error(`Eficiencia con ${last.workers} procesos por debajo de ${MIN_EFFICIENCY}`);
+  process.exit(1);
+}
@@ -1,9 +1,14 @@
 import express from 'express';
 import cors from 'cors';
 import http from 'http';
-import { networkInterfaces } from 'os';
+import cluster from 'cluster';
+import { cpus, networkInterfaces } from 'os';
 import deviceRoutes from './routes/device.routes';
+import historyRoutes from './routes/history.routes';
 import { WebSocketService } from './services/websocket.service';
+import { deviceRegistry } from './services/device-registry';
+import { renderMetrics, setCommonLabel } from './services/metrics';
+import { commandTraces } from './services/command-trace';
 
 const app = express();
 const server = http.createServer(app);
@@ -43,6 +48,15 @@ const getWiFiIP = () => {
 const SERVER_IP = getWiFiIP();
 const HTTP_PORT = 3000;
 const WS_PORT = 80;
+// Procesos del relay: RELAY_WORKERS=N o "auto" (uno por núcleo). Con más de
+// uno, el proceso principal sólo los arranca y reparte las conexiones.
+const WORKERS = process.env.RELAY_WORKERS === 'auto' ? cpus().length : Number(process.env.RELAY_WORKERS) || 1;
+// Índice de este proceso (0..WORKERS-1) con varios; se conserva al reemplazarlo
+const WORKER = process.env.RELAY_WORKER;
+// Con varios procesos, /metrics y /api/traces en HTTP_PORT los responde uno
+// cualquiera: cada proceso los sirve además en METRICS_PORT + índice, con la
+// etiqueta worker, y ése es el puerto que hay que consultar
+const METRICS_PORT = Number(process.env.METRICS_PORT) || 9400;
 
 console.log('Servidor configurado con IP:', SERVER_IP);
 
@@ -62,16 +76,96 @@ app.get('/api/server-info', (req, res) => {
 });
 
 app.use('/api', deviceRoutes);
+app.use('/api', historyRoutes);
 
-// Crear servidor HTTP
-const httpServer = app.listen(HTTP_PORT, '0.0.0.0', () => {
-  console.log(`HTTP Server running on http://${SERVER_IP}:${HTTP_PORT}`);
-});
+// Métricas en formato de texto de Prometheus (de este proceso)
+const sendMetrics = (req: express.Request, res: express.Response) => {
+  res.type('text/plain; version=0.0.4').send(renderMetrics());
+};
 
-// Crear servidor WebSocket
-const wss = new WebSocketService(server);
-server.listen(WS_PORT, '0.0.0.0', () => {
-  console.log(`WebSocket Server running on ws://${SERVER_IP}:${WS_PORT}`);
-});
+// p50/p99 por tramo de los comandos con traza (ver CommandTraces), de este proceso
+const sendTraces = (req: express.Request, res: express.Response) => {
+  if (WORKER !== undefined) {
+    res.set('X-Relay-Worker', WORKER);
+  }
+  res.json(commandTraces.summary());
+};
+
+app.get('/metrics', sendMetrics);
+app.get('/api/traces', sendTraces);
+
+if (WORKERS > 1 && cluster.isPrimary) {
+  console.log(`Arrancando ${WORKERS} procesos del relay`);
+  // Los procesos se reparten paneles y dispositivos por el bus de Postgres
+  const indexes = new Map<number, number>();  // id del proceso -> índice
+  const fork = (index: number) => {
+    const worker = cluster.fork({ RELAY_BUS: '1', RELAY_WORKER: String(index) });
+    indexes.set(worker.id, index);
+  };
+  for (let i = 0; i < WORKERS; i++) {
+    fork(i);
+  }
+  let stopping = false;
+  const stop = () => {
+    stopping = true;
+    for (const worker of Object.values(cluster.workers ?? {})) {
+      worker?.kill('SIGTERM');
+    }
+  };
+  process.once('SIGINT', stop);
+  process.once('SIGTERM', stop);
+  cluster.on('exit', (worker, code) => {
+    const index = indexes.get(worker.id) ?? 0;
+    indexes.delete(worker.id);
+    if (stopping) {
+      return;
+    }
+    console.warn(`Proceso ${worker.process.pid} terminado (${code}), arrancando otro`);
+    fork(index);
+  });
+} else {
+  startServer();
+}
+
+function startServer() {
+  // Crear servidor HTTP
+  app.listen(HTTP_PORT, '0.0.0.0', () => {
+    console.log(`HTTP Server running on http://${SERVER_IP}:${HTTP_PORT}`);
+  });
+
+  if (WORKER !== undefined) {
+    setCommonLabel('worker', WORKER);
+    const metrics = express();
+    metrics.get('/metrics', sendMetrics);
+    metrics.get('/api/traces', sendTraces);
+    const port = METRICS_PORT + Number(WORKER);
+    metrics.listen(port, '0.0.0.0', () => {
+      console.log(`Métricas del proceso ${WORKER} en http://${SERVER_IP}:${port}/metrics`);
+    });
+  }
+
+  // Cargar el registro de dispositivos una sola vez; las conexiones lo esperan
+  deviceRegistry.load().catch(error => {
+    console.error('Error cargando el registro de dispositivos:', error);
+  });
+
+  // Crear servidor WebSocket
+  const wss = new WebSocketService(server);
+  server.listen(WS_PORT, '0.0.0.0', () => {
+    console.log(`WebSocket Server running on ws://${SERVER_IP}:${WS_PORT}`);
+  });
+
+  // Cierre ordenado: escribir los estados pendientes antes de salir
+  const shutdown = async (signal: string) => {
+    console.log(`${signal} recibido, cerrando...`);
+    try {
+      await wss.close();
+    } finally {
+      process.exit(0);
+    }
+  };
+  process.once('SIGINT', () => shutdown('SIGINT'));
+  process.once('SIGTERM', () => shutdown('SIGTERM'));
+}
 
 export { app, server }; 
\ No newline at end of file
@@ -1,9 +1,18 @@
-import { Pool } from 'pg';
+import { Pool, PoolConfig, QueryConfig, QueryResult } from 'pg';
+import { dbQueryDuration } from '../services/metrics';
 
-export const pool = new Pool({
+export const dbConfig: PoolConfig = {
   user: 'postgres',
   host: 'localhost',
   database: 'cliente',
   password: 'password',
   port: 5432,
-}); 
+};
+
+export const pool = new Pool(dbConfig);
+
+/** pool.query con la duración registrada por método (ver /metrics) */
+export function timedQuery(method: string, text: string | QueryConfig, values?: unknown[]): Promise<QueryResult> {
+  const stop = dbQueryDuration.startTimer(method);
+  return (typeof text === 'string' ? pool.query(text, values) : pool.query(text)).finally(stop);
+}
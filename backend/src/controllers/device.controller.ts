@@ -1,10 +1,54 @@
 import { Request, Response } from 'express';
-import { DeviceModel } from '../models/device.model';
+import { createHash } from 'crypto';
+import { DeviceModel, LIST_COLUMNS } from '../models/device.model';
+import { deviceRegistry } from '../services/device-registry';
+
+const DEFAULT_PAGE_SIZE = 1000;
+const MAX_PAGE_SIZE = 5000;
 
 export class DeviceController {
+  /**
+   * GET /api/devices?fields=id,name,status&after=<id>&limit=<n>
+   * Página ordenada por id; si hay más, la siguiente va en la cabecera Link.
+   * El ETag es la versión de la tabla más los parámetros: un sondeo sin
+   * cambios cuesta una lectura de una fila y un 304.
+   */
   static async getAllDevices(req: Request, res: Response) {
+    let fields = LIST_COLUMNS;
+    if (typeof req.query.fields === 'string') {
+      const requested = req.query.fields.split(',').map(field => field.trim()).filter(Boolean);
+      const unknown = requested.filter(field => !LIST_COLUMNS.includes(field));
+      if (unknown.length > 0) {
+        return res.status(400).json({ error: `Unknown fields: ${unknown.join(', ')}` });
+      }
+      // El id siempre se devuelve: es el cursor de la página siguiente
+      fields = ['id', ...requested.filter(field => field !== 'id')];
+    }
+    const after = Math.max(0, Number(req.query.after) || 0);
+    const limit = Math.min(MAX_PAGE_SIZE, Math.max(1, Number(req.query.limit) || DEFAULT_PAGE_SIZE));
+
     try {
-      const devices = await DeviceModel.getAllDevices();
+      // data y updated_at cambian en cada escritura de estado o de salud: sólo
+      // cuentan para la versión si el listado las devuelve
+      const version = await DeviceModel.getListVersion(fields.includes('data') || fields.includes('updated_at'));
+      const params = createHash('sha1').update(`${fields.join(',')}|${after}|${limit}`).digest('hex').slice(0, 12);
+      const etag = `W/"${version}-${params}"`;
+      res.setHeader('ETag', etag);
+      res.setHeader('Cache-Control', 'no-cache');
+
+      const ifNoneMatch = req.headers['if-none-match'];
+      if (ifNoneMatch && ifNoneMatch.split(',').some(tag => tag.trim() === etag)) {
+        return res.status(304).end();
+      }
+
+      const devices = await DeviceModel.listDevices({ fields, after, limit });
+      if (devices.length === limit) {
+        const next = new URLSearchParams({ after: String(devices[devices.length - 1].id), limit: String(limit) });
+        if (typeof req.query.fields === 'string') {
+          next.set('fields', req.query.fields);
+        }
+        res.setHeader('Link', `<${req.baseUrl}${req.path}?${next}>; rel="next"`);
+      }
       res.json(devices);
     } catch (error) {
       res.status(500).json({ error: error.message });
@@ -26,6 +70,7 @@ export class DeviceController {
   static async createDevice(req: Request, res: Response) {
     try {
       const device = await DeviceModel.createDevice(req.body);
+      deviceRegistry.put(device);
       res.status(201).json(device);
     } catch (error) {
       res.status(500).json({ error: error.message });
@@ -38,6 +83,7 @@ export class DeviceController {
       if (!device) {
         return res.status(404).json({ error: 'Device not found' });
       }
+      deviceRegistry.put(device);
       res.json(device);
     } catch (error) {
       res.status(500).json({ error: error.message });
@@ -47,6 +93,7 @@ export class DeviceController {
   static async deleteDevice(req: Request, res: Response) {
     try {
       await DeviceModel.deleteDevice(req.params.id);
+      deviceRegistry.removeById(Number(req.params.id));
       res.status(204).send();
     } catch (error) {
       res.status(500).json({ error: error.message });
@@ -0,0 +1,54 @@
+import { Request, Response } from 'express';
+import { HistoryModel } from '../models/history.model';
+
+const DEFAULT_POINTS = 200;
+const MAX_POINTS = 2000;
+const DEFAULT_RANGE_MS = 24 * 60 * 60 * 1000;
+
+function parseTime(value: unknown, fallback: number): Date | null {
+  if (value === undefined) {
+    return new Date(fallback);
+  }
+  const date = new Date(String(value));
+  return isNaN(date.getTime()) ? null : date;
+}
+
+export class HistoryController {
+  /**
+   * GET /api/history?ip=...&metric=led_1&from=ISO&to=ISO&points=200
+   * Serie reducida en el servidor a unos `points` intervalos (min/max/avg)
+   */
+  static async getSeries(req: Request, res: Response) {
+    const { ip, metric } = req.query;
+    if (typeof ip !== 'string' || typeof metric !== 'string') {
+      return res.status(400).json({ error: 'ip and metric are required' });
+    }
+    const to = parseTime(req.query.to, Date.now());
+    const from = to && parseTime(req.query.from, to.getTime() - DEFAULT_RANGE_MS);
+    if (!from || !to || from >= to) {
+      return res.status(400).json({ error: 'Invalid time range' });
+    }
+    const points = Math.min(MAX_POINTS, Math.max(1, Number(req.query.points) || DEFAULT_POINTS));
+    const step = Math.max(1, Math.ceil((to.getTime() - from.getTime()) / 1000 / points));
+
+    try {
+      const buckets = await HistoryModel.series(ip, metric, from, to, step);
+      res.json({ ip, metric, from, to, step, buckets });
+    } catch (error) {
+      res.status(500).json({ error: error.message });
+    }
+  }
+
+  /** GET /api/history/metrics?ip=... */
+  static async getMetrics(req: Request, res: Response) {
+    const { ip } = req.query;
+    if (typeof ip !== 'string') {
+      return res.status(400).json({ error: 'ip is required' });
+    }
+    try {
+      res.json(await HistoryModel.metrics(ip));
+    } catch (error) {
+      res.status(500).json({ error: error.message });
+    }
+  }
+}
@@ -9,6 +9,16 @@ CREATE TABLE IF NOT EXISTS dispositivos_conectados (
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
 );
 
+-- Una fila por dispositivo: el registro crea con INSERT ... ON CONFLICT (ip).
+-- Antes de crear el índice se eliminan los duplicados que dejaba la
+-- comprobación previa a la inserción, conservando la fila más antigua.
+DELETE FROM dispositivos_conectados a
+    USING dispositivos_conectados b
+    WHERE a.ip = b.ip AND a.id > b.id;
+
+CREATE UNIQUE INDEX IF NOT EXISTS dispositivos_conectados_ip_key
+    ON dispositivos_conectados (ip);
+
 CREATE OR REPLACE FUNCTION update_updated_at_column()
 RETURNS TRIGGER AS $$
 BEGIN
@@ -21,4 +31,79 @@ DROP TRIGGER IF EXISTS update_dispositivos_conectados_updated_at ON dispositivos
 CREATE TRIGGER update_dispositivos_conectados_updated_at
     BEFORE UPDATE ON dispositivos_conectados
     FOR EACH ROW
-    EXECUTE FUNCTION update_updated_at_column(); 
\ No newline at end of file
+    EXECUTE FUNCTION update_updated_at_column();
+
+-- Versiones de la tabla de dispositivos para el ETag de GET /api/devices.
+-- Son secuencias: nextval no bloquea ninguna fila, así que las escrituras
+-- concurrentes no se esperan unas a otras.
+--   dispositivos_version_seq: altas, bajas y cambios de name, type, ip o status
+--   dispositivos_detalle_seq: cualquier UPDATE (data y updated_at); sólo
+--                             cuenta si el listado pide esas columnas
+-- nextval no es transaccional: un sondeo entre la sentencia y su COMMIT puede
+-- llevarse la versión nueva con las filas anteriores hasta el cambio siguiente.
+CREATE SEQUENCE IF NOT EXISTS dispositivos_version_seq;
+CREATE SEQUENCE IF NOT EXISTS dispositivos_detalle_seq;
+
+CREATE OR REPLACE FUNCTION bump_dispositivos_version()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM nextval('dispositivos_version_seq');
+    RETURN NULL;
+END;
+$$ language 'plpgsql';
+
+CREATE OR REPLACE FUNCTION bump_dispositivos_detalle()
+RETURNS TRIGGER AS $$
+BEGIN
+    PERFORM nextval('dispositivos_detalle_seq');
+    RETURN NULL;
+END;
+$$ language 'plpgsql';
+
+DROP TRIGGER IF EXISTS bump_dispositivos_version ON dispositivos_conectados;
+CREATE TRIGGER bump_dispositivos_version
+    AFTER INSERT OR DELETE ON dispositivos_conectados
+    FOR EACH STATEMENT
+    EXECUTE FUNCTION bump_dispositivos_version();
+
+-- Por fila y sólo si el valor cambia: el registro repite "SET ip" en cada
+-- reconexión y la presencia reescribe estados iguales
+DROP TRIGGER IF EXISTS bump_dispositivos_version_update ON dispositivos_conectados;
+CREATE TRIGGER bump_dispositivos_version_update
+    AFTER UPDATE OF name, type, ip, status ON dispositivos_conectados
+    FOR EACH ROW
+    WHEN (OLD.name IS DISTINCT FROM NEW.name OR OLD.type IS DISTINCT FROM NEW.type
+          OR OLD.ip IS DISTINCT FROM NEW.ip OR OLD.status IS DISTINCT FROM NEW.status)
+    EXECUTE FUNCTION bump_dispositivos_version();
+
+DROP TRIGGER IF EXISTS bump_dispositivos_detalle ON dispositivos_conectados;
+CREATE TRIGGER bump_dispositivos_detalle
+    AFTER UPDATE ON dispositivos_conectados
+    FOR EACH STATEMENT
+    EXECUTE FUNCTION bump_dispositivos_detalle();
+
+-- Historial de estados y medidas: sólo inserciones, particionado por día.
+-- value es numérico: 1/0 para las salidas, el valor para las de salud.
+CREATE TABLE IF NOT EXISTS historial (
+    ts TIMESTAMPTZ NOT NULL,
+    ip VARCHAR(50) NOT NULL,
+    metric VARCHAR(64) NOT NULL,
+    value DOUBLE PRECISION NOT NULL
+) PARTITION BY RANGE (ts);
+
+CREATE INDEX IF NOT EXISTS historial_ip_metric_ts
+    ON historial (ip, metric, ts);
+
+-- Recoge las filas de días sin partición (no deberían llegar: el relay crea
+-- la del día y la del siguiente al arrancar y cada hora)
+CREATE TABLE IF NOT EXISTS historial_default PARTITION OF historial DEFAULT;
+
+-- Partición de un día (UTC); borrar un día antiguo es un DROP TABLE de la suya
+CREATE OR REPLACE FUNCTION crear_particion_historial(dia DATE)
+RETURNS void AS $$
+BEGIN
+    EXECUTE format('CREATE TABLE IF NOT EXISTS %I PARTITION OF historial FOR VALUES FROM (%L) TO (%L)',
+                   'historial_' || to_char(dia, 'YYYYMMDD'),
+                   dia::timestamp AT TIME ZONE 'UTC', (dia + 1)::timestamp AT TIME ZONE 'UTC');
+END;
+$$ language 'plpgsql';
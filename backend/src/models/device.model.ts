@@ -1,19 +1,82 @@
-import { pool } from '../config/db';
+import { timedQuery } from '../config/db';
 import { Device } from '../types/device';
 
+/** Estado agrupado de un dispositivo para la escritura por lotes */
+export interface DeviceStateRow {
+  ip: string;
+  state: 'on' | 'off';                    // Último estado recibido
+  states: Record<string, 'on' | 'off'>;   // Último estado de cada salida
+}
+
+/** Columnas del registro en memoria: todo menos el JSONB de datos */
+export interface DeviceRecord {
+  id: number;
+  name: string | null;
+  type: string | null;
+  ip: string;
+  status: string;
+}
+
+const RECORD_COLUMNS = 'id, name, type, ip, status';
+
+/** Columnas que se pueden pedir en GET /api/devices?fields=... */
+export const LIST_COLUMNS = ['id', 'name', 'type', 'ip', 'status', 'data', 'created_at', 'updated_at'];
+
+/** Página del listado: columnas (de LIST_COLUMNS) y filas con id > after */
+export interface DeviceListQuery {
+  fields: string[];
+  after: number;
+  limit: number;
+}
+
 export class DeviceModel {
   static async getAllDevices() {
     try {
-      const result = await pool.query('SELECT * FROM dispositivos_conectados');
+      const result = await timedQuery('DeviceModel.getAllDevices', 'SELECT * FROM dispositivos_conectados');
       return result.rows;
     } catch (error) {
       throw new Error(`Error getting devices: ${error}`);
     }
   }
 
+  /**
+   * Página del listado ordenada por id (paginación por clave: cada página es
+   * un recorrido del índice desde `after`, sin OFFSET)
+   */
+  static async listDevices(query: DeviceListQuery) {
+    const columns = query.fields.filter(field => LIST_COLUMNS.includes(field));
+    try {
+      const result = await timedQuery('DeviceModel.listDevices',
+        `SELECT ${columns.join(', ')} FROM dispositivos_conectados WHERE id > $1 ORDER BY id LIMIT $2`,
+        [query.after, query.limit]
+      );
+      return result.rows;
+    } catch (error) {
+      throw new Error(`Error listing devices: ${error}`);
+    }
+  }
+
+  /**
+   * Versión de la tabla, base del ETag del listado. Con `detail` incluye
+   * también los cambios de data y updated_at (ver dispositivos_detalle_seq).
+   */
+  static async getListVersion(detail: boolean): Promise<string> {
+    try {
+      const result = await timedQuery('DeviceModel.getListVersion', {
+        name: 'device-list-version',
+        text: `SELECT (SELECT last_value FROM dispositivos_version_seq) AS version,
+                      (SELECT last_value FROM dispositivos_detalle_seq) AS detail`,
+      });
+      const row = result.rows[0];
+      return detail ? `${row.version}.${row.detail}` : String(row.version);
+    } catch (error) {
+      throw new Error(`Error getting device list version: ${error}`);
+    }
+  }
+
   static async getDeviceById(id: string) {
     try {
-      const result = await pool.query('SELECT * FROM dispositivos_conectados WHERE id = $1', [id]);
+      const result = await timedQuery('DeviceModel.getDeviceById', 'SELECT * FROM dispositivos_conectados WHERE id = $1', [id]);
       return result.rows[0];
     } catch (error) {
       throw new Error(`Error getting device: ${error}`);
@@ -22,7 +85,7 @@ export class DeviceModel {
 
   static async createDevice(device: Partial<Device>) {
     try {
-      const result = await pool.query(
+      const result = await timedQuery('DeviceModel.createDevice',
         'INSERT INTO dispositivos_conectados (name, type, ip, status, data) VALUES ($1, $2, $3, $4, $5) RETURNING *',
         [device.name, device.type, device.ip, device.status, device.data || {}]
       );
@@ -34,7 +97,7 @@ export class DeviceModel {
 
   static async updateDevice(id: string, device: Partial<Device>) {
     try {
-      const result = await pool.query(
+      const result = await timedQuery('DeviceModel.updateDevice',
         'UPDATE dispositivos_conectados SET name = $1, type = $2, status = $3 WHERE id = $4 RETURNING *',
         [device.name, device.type, device.status, id]
       );
@@ -46,7 +109,7 @@ export class DeviceModel {
 
   static async deleteDevice(id: string) {
     try {
-      await pool.query('DELETE FROM dispositivos_conectados WHERE id = $1', [id]);
+      await timedQuery('DeviceModel.deleteDevice', 'DELETE FROM dispositivos_conectados WHERE id = $1', [id]);
       return true;
     } catch (error) {
       throw new Error(`Error deleting device: ${error}`);
@@ -55,16 +118,53 @@ export class DeviceModel {
 
   static async findByIp(ip: string) {
     try {
-      const result = await pool.query('SELECT * FROM dispositivos_conectados WHERE ip = $1', [ip]);
+      const result = await timedQuery('DeviceModel.findByIp', {
+        name: 'device-find-by-ip',
+        text: 'SELECT * FROM dispositivos_conectados WHERE ip = $1',
+        values: [ip],
+      });
       return result.rows[0];
     } catch (error) {
       throw new Error(`Error finding device: ${error}`);
     }
   }
 
+  /** Todos los dispositivos sin el JSONB de datos, para cargar el registro en memoria */
+  static async getAllRecords(): Promise<DeviceRecord[]> {
+    try {
+      const result = await timedQuery('DeviceModel.getAllRecords', {
+        name: 'device-all-records',
+        text: `SELECT ${RECORD_COLUMNS} FROM dispositivos_conectados`,
+      });
+      return result.rows;
+    } catch (error) {
+      throw new Error(`Error getting device records: ${error}`);
+    }
+  }
+
+  /**
+   * Crea el dispositivo de esa IP o devuelve el existente, en una sola
+   * sentencia y sin carreras entre conexiones simultáneas (índice único en ip)
+   */
+  static async upsertByIp(device: Partial<Device>): Promise<DeviceRecord> {
+    try {
+      const result = await timedQuery('DeviceModel.upsertByIp', {
+        name: 'device-upsert-by-ip',
+        text: `INSERT INTO dispositivos_conectados (name, type, ip, status, data)
+               VALUES ($1, $2, $3, $4, $5)
+               ON CONFLICT (ip) DO UPDATE SET ip = EXCLUDED.ip
+               RETURNING ${RECORD_COLUMNS}`,
+        values: [device.name, device.type, device.ip, device.status, device.data || {}],
+      });
+      return result.rows[0];
+    } catch (error) {
+      throw new Error(`Error upserting device: ${error}`);
+    }
+  }
+
   static async updateDeviceState(ip: string, state: 'on' | 'off') {
     try {
-      const result = await pool.query(
+      const result = await timedQuery('DeviceModel.updateDeviceState',
         'UPDATE dispositivos_conectados SET data = jsonb_set(COALESCE(data, \'{}\'), \'{state}\', $1) WHERE ip = $2 RETURNING *',
         [JSON.stringify(state), ip]
       );
@@ -74,15 +174,88 @@ export class DeviceModel {
     }
   }
 
-  static async updateDeviceStatus(ip: string, status: string) {
+  /**
+   * Actualiza el estado de varios dispositivos en una sola sentencia
+   * (UPDATE ... FROM VALUES). Devuelve el número de filas actualizadas.
+   */
+  static async updateDeviceStates(rows: DeviceStateRow[]): Promise<number> {
+    if (rows.length === 0) {
+      return 0;
+    }
+    const values: string[] = [];
+    const params: string[] = [];
+    rows.forEach((row, i) => {
+      values.push(`($${i * 3 + 1}, $${i * 3 + 2}, $${i * 3 + 3}::jsonb)`);
+      params.push(row.ip, JSON.stringify(row.state), JSON.stringify(row.states));
+    });
     try {
-      const result = await pool.query(
-        'UPDATE dispositivos_conectados SET status = $1 WHERE ip = $2 RETURNING *',
-        [status, ip]
+      const result = await timedQuery('DeviceModel.updateDeviceStates',
+        `UPDATE dispositivos_conectados AS d
+         SET data = COALESCE(d.data, '{}'::jsonb)
+           || jsonb_build_object('state', v.state::jsonb,
+                                 'states', COALESCE(d.data->'states', '{}'::jsonb) || v.states)
+         FROM (VALUES ${values.join(', ')}) AS v(ip, state, states)
+         WHERE d.ip = v.ip`,
+        params
       );
+      return result.rowCount ?? 0;
+    } catch (error) {
+      throw new Error(`Error updating device states: ${error}`);
+    }
+  }
+
+  static async updateDeviceStatus(ip: string, status: string) {
+    try {
+      const result = await timedQuery('DeviceModel.updateDeviceStatus', {
+        name: 'device-update-status',
+        text: `UPDATE dispositivos_conectados SET status = $1 WHERE ip = $2 RETURNING ${RECORD_COLUMNS}`,
+        values: [status, ip],
+      });
       return result.rows[0];
     } catch (error) {
       throw new Error(`Error updating device status: ${error}`);
     }
   }
+
+  /**
+   * Cambia el estado de varios dispositivos en una sola sentencia (UPDATE ...
+   * FROM VALUES). Devuelve los registros actualizados.
+   */
+  static async updateDeviceStatuses(changes: Array<{ ip: string; status: string }>): Promise<DeviceRecord[]> {
+    if (changes.length === 0) {
+      return [];
+    }
+    const values: string[] = [];
+    const params: string[] = [];
+    changes.forEach((change, i) => {
+      values.push(`($${i * 2 + 1}, $${i * 2 + 2})`);
+      params.push(change.ip, change.status);
+    });
+    try {
+      const result = await timedQuery('DeviceModel.updateDeviceStatuses',
+        `UPDATE dispositivos_conectados AS d
+         SET status = v.status
+         FROM (VALUES ${values.join(', ')}) AS v(ip, status)
+         WHERE d.ip = v.ip
+         RETURNING d.id, d.name, d.type, d.ip, d.status`,
+        params
+      );
+      return result.rows;
+    } catch (error) {
+      throw new Error(`Error updating device statuses: ${error}`);
+    }
+  }
+
+  static async updateDeviceHealth(ip: string, health: Record<string, unknown>) {
+    try {
+      const result = await timedQuery('DeviceModel.updateDeviceHealth', {
+        name: 'device-update-health',
+        text: 'UPDATE dispositivos_conectados SET data = jsonb_set(COALESCE(data, \'{}\'), \'{health}\', $1) WHERE ip = $2 RETURNING id',
+        values: [JSON.stringify(health), ip],
+      });
+      return result.rows[0];
+    } catch (error) {
+      throw new Error(`Error updating device health: ${error}`);
+    }
+  }
 } 
\ No newline at end of file
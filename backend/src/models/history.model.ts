@@ -0,0 +1,95 @@
+import { timedQuery } from '../config/db';
+
+/** Una medida del historial */
+export interface HistoryRow {
+  ts: Date;
+  ip: string;
+  metric: string;   // Identificador de salida (led_1) o "health.<campo>"
+  value: number;
+}
+
+/** Un intervalo de la serie reducida */
+export interface HistoryBucket {
+  bucket: Date;
+  min: number;
+  max: number;
+  avg: number;
+  count: number;
+}
+
+export class HistoryModel {
+  /**
+   * Inserta un lote con una sola sentencia de tamaño fijo: cada columna va
+   * como un array y unnest() las convierte en filas
+   */
+  static async insertBatch(rows: HistoryRow[]): Promise<number> {
+    if (rows.length === 0) {
+      return 0;
+    }
+    try {
+      const result = await timedQuery('HistoryModel.insertBatch', {
+        name: 'history-insert-batch',
+        text: `INSERT INTO historial (ts, ip, metric, value)
+               SELECT * FROM unnest($1::timestamptz[], $2::varchar[], $3::varchar[], $4::float8[])`,
+        values: [
+          rows.map(row => row.ts.toISOString()),
+          rows.map(row => row.ip),
+          rows.map(row => row.metric),
+          rows.map(row => row.value),
+        ],
+      });
+      return result.rowCount ?? 0;
+    } catch (error) {
+      throw new Error(`Error inserting history: ${error}`);
+    }
+  }
+
+  /** Crea las particiones de `days` días a partir de `from` (si no existen) */
+  static async ensurePartitions(from: Date, days: number) {
+    try {
+      await timedQuery('HistoryModel.ensurePartitions',
+        'SELECT crear_particion_historial(($1::date + d)::date) FROM generate_series(0, $2 - 1) AS d',
+        [from.toISOString().slice(0, 10), days]
+      );
+    } catch (error) {
+      throw new Error(`Error creating history partitions: ${error}`);
+    }
+  }
+
+  /**
+   * Serie de una medida en [from, to) reducida en el servidor a intervalos de
+   * `stepSeconds` con mínimo, máximo y media
+   */
+  static async series(ip: string, metric: string, from: Date, to: Date, stepSeconds: number): Promise<HistoryBucket[]> {
+    try {
+      const result = await timedQuery('HistoryModel.series', {
+        name: 'history-series',
+        text: `SELECT to_timestamp(floor(extract(epoch FROM ts) / $5) * $5) AS bucket,
+                      min(value) AS min, max(value) AS max, avg(value) AS avg, count(*)::int AS count
+               FROM historial
+               WHERE ip = $1 AND metric = $2 AND ts >= $3 AND ts < $4
+               GROUP BY 1
+               ORDER BY 1`,
+        values: [ip, metric, from.toISOString(), to.toISOString(), stepSeconds],
+      });
+      return result.rows;
+    } catch (error) {
+      throw new Error(`Error querying history: ${error}`);
+    }
+  }
+
+  /** Medidas de un dispositivo con historial en la última semana */
+  static async metrics(ip: string): Promise<string[]> {
+    try {
+      const result = await timedQuery('HistoryModel.metrics',
+        `SELECT DISTINCT metric FROM historial
+         WHERE ip = $1 AND ts >= now() - interval '7 days'
+         ORDER BY metric`,
+        [ip]
+      );
+      return result.rows.map((row: { metric: string }) => row.metric);
+    } catch (error) {
+      throw new Error(`Error listing history metrics: ${error}`);
+    }
+  }
+}
@@ -0,0 +1,9 @@
+import { Router } from 'express';
+import { HistoryController } from '../controllers/history.controller';
+
+const router = Router();
+
+router.get('/history', HistoryController.getSeries);
+router.get('/history/metrics', HistoryController.getMetrics);
+
+export default router;
@@ -0,0 +1,166 @@
+import WebSocket from 'ws';
+import { sendQueued } from './send-queue';
+import { commandTraces, isTraceId } from './command-trace';
+
+interface InFlightCommand {
+  seq: number;
+  type: string;
+  payload: string;
+  sentAt: number;
+  attempts: number;
+}
+
+interface DeviceLink {
+  ws: WebSocket | null;
+  nextSeq: number;
+  inFlight: Map<number, InFlightCommand>;
+  queue: any[];
+}
+
+const DEFAULT_WINDOW = 16;
+const MAX_QUEUED = 256;
+const DEFAULT_ACK_TIMEOUT_MS = 5000;
+const MAX_ATTEMPTS = 3;          // Envío inicial y dos reenvíos
+
+/**
+ * Envía comandos numerados a cada dispositivo con una ventana de comandos
+ * pendientes de confirmación: hasta `windowSize` comandos viajan a la vez y
+ * el resto espera en cola. El dispositivo confirma por "seq" y descarta los
+ * repetidos, así que los pendientes se reenvían tal cual tras una reconexión.
+ *
+ * Un comando sin confirmación tras `ackTimeoutMs` se reenvía con la misma
+ * "seq"; tras MAX_ATTEMPTS envíos se descarta y libera su hueco, para que un
+ * dispositivo que no responde a un comando no bloquee los siguientes.
+ */
+export class CommandPipeline {
+  private links: Map<string, DeviceLink> = new Map();
+  private timer: NodeJS.Timeout | null = null;
+  private counters = { resent: 0, expired: 0 };
+
+  constructor(
+    private windowSize: number = Number(process.env.COMMAND_WINDOW) || DEFAULT_WINDOW,
+    private ackTimeoutMs: number = Number(process.env.COMMAND_ACK_TIMEOUT_MS) || DEFAULT_ACK_TIMEOUT_MS,
+  ) {}
+
+  public start() {
+    if (!this.timer) {
+      this.timer = setInterval(() => this.expire(), Math.max(100, this.ackTimeoutMs / 2));
+      this.timer.unref();
+    }
+  }
+
+  public stop() {
+    if (this.timer) {
+      clearInterval(this.timer);
+      this.timer = null;
+    }
+  }
+
+  public attach(ip: string, ws: WebSocket, lastSeq?: number) {
+    const link = this.getLink(ip);
+    const reconnected = link.ws !== ws;
+    link.ws = ws;
+
+    // Continuar la numeración desde la última secuencia aplicada por el dispositivo
+    if (typeof lastSeq === 'number' && lastSeq >= link.nextSeq) {
+      link.nextSeq = lastSeq + 1;
+    }
+
+    if (reconnected) {
+      for (const command of link.inFlight.values()) {
+        command.sentAt = Date.now();
+        command.attempts = 1;
+        sendQueued(ws, command.payload, { type: command.type });
+      }
+    }
+    this.pump(link);
+  }
+
+  public detach(ip: string, ws: WebSocket) {
+    const link = this.links.get(ip);
+    if (link && link.ws === ws) {
+      link.ws = null;
+    }
+  }
+
+  public hasDevice(ip: string) {
+    return this.links.get(ip)?.ws != null;
+  }
+
+  public send(ip: string, command: any) {
+    const link = this.getLink(ip);
+    if (link.queue.length >= MAX_QUEUED) {
+      console.warn('Cola de comandos llena, descartando el más antiguo para', ip);
+      link.queue.shift();
+    }
+    link.queue.push(command);
+    this.pump(link);
+  }
+
+  public ack(ip: string, seq: number) {
+    const link = this.links.get(ip);
+    if (link && link.inFlight.delete(seq)) {
+      this.pump(link);
+    }
+  }
+
+  public stats() {
+    return { ...this.counters };
+  }
+
+  private getLink(ip: string): DeviceLink {
+    let link = this.links.get(ip);
+    if (!link) {
+      link = { ws: null, nextSeq: 1, inFlight: new Map(), queue: [] };
+      this.links.set(ip, link);
+    }
+    return link;
+  }
+
+  // Reenvía o descarta los comandos sin confirmar de los dispositivos conectados
+  private expire() {
+    const now = Date.now();
+    this.links.forEach((link, ip) => {
+      const ws = link.ws;
+      if (!ws || ws.readyState !== WebSocket.OPEN || link.inFlight.size === 0) {
+        return;
+      }
+      let freed = false;
+      for (const command of link.inFlight.values()) {
+        if (now - command.sentAt < this.ackTimeoutMs) {
+          continue;
+        }
+        if (command.attempts >= MAX_ATTEMPTS) {
+          console.warn(`Comando seq=${command.seq} sin confirmar tras ${command.attempts} envíos, descartado para`, ip);
+          link.inFlight.delete(command.seq);
+          this.counters.expired++;
+          freed = true;
+        } else {
+          command.attempts++;
+          command.sentAt = now;
+          this.counters.resent++;
+          sendQueued(ws, command.payload, { type: command.type });
+        }
+      }
+      if (freed) {
+        this.pump(link);
+      }
+    });
+  }
+
+  private pump(link: DeviceLink) {
+    while (
+      link.ws && link.ws.readyState === WebSocket.OPEN &&
+      link.inFlight.size < this.windowSize && link.queue.length > 0
+    ) {
+      const seq = link.nextSeq++;
+      const command = link.queue.shift();
+      const payload = JSON.stringify({ ...command, seq });
+      link.inFlight.set(seq, { seq, type: command.type, payload, sentAt: Date.now(), attempts: 1 });
+      sendQueued(link.ws, payload, { type: command.type });
+      if (isTraceId(command.trace)) {
+        commandTraces.sent(command.trace);
+      }
+    }
+  }
+}
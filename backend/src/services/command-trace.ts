@@ -0,0 +1,146 @@
+import { performance } from 'perf_hooks';
+import { gauge } from './metrics';
+
+/**
+ * Tramos de un toggle_device con traza, cada uno medido con un solo reloj:
+ *  - relay_queue:       relay, comando recibido -> entregado al dispositivo
+ *  - device_apply:      dispositivo, recepción -> salida aplicada
+ *  - device_confirm:    dispositivo, salida aplicada -> confirmación enviada
+ *  - device_network:    ida y vuelta relay <-> dispositivo menos el tiempo en él
+ *  - relay_broadcast:   relay, confirmación recibida -> publicada a los paneles
+ *  - frontend_render:   panel, confirmación recibida -> pintada
+ *  - dashboard_network: ida y vuelta panel <-> relay (lo que queda del total)
+ *  - total:             panel, clic -> confirmación pintada
+ */
+const HOPS = [
+  'relay_queue', 'device_apply', 'device_confirm', 'device_network',
+  'relay_broadcast', 'frontend_render', 'dashboard_network', 'total',
+] as const;
+type Hop = typeof HOPS[number];
+
+const WINDOW = 1024;           // Muestras recientes por tramo para p50/p99
+const MAX_PENDING = 1000;      // Trazas en curso; se descartan las más antiguas
+export const TRACE_ID_MAX = 32;
+
+interface PendingTrace {
+  relayIn?: number;
+  relayOut?: number;
+  ackIn?: number;
+  broadcastAt?: number;
+}
+
+export interface HopSummary {
+  count: number;
+  p50_ms: number;
+  p99_ms: number;
+}
+
+/** Ventana circular de las últimas WINDOW muestras (ms) de un tramo */
+class HopWindow {
+  private samples = new Float64Array(WINDOW);
+  private next = 0;
+  public count = 0;
+
+  public add(ms: number) {
+    this.samples[this.next] = ms;
+    this.next = (this.next + 1) % WINDOW;
+    this.count++;
+  }
+
+  public summary(): HopSummary {
+    const filled = Math.min(this.count, WINDOW);
+    const sorted = this.samples.slice(0, filled).sort();
+    const at = (q: number) => (filled ? sorted[Math.min(filled - 1, Math.floor(q * filled))] : 0);
+    return { count: this.count, p50_ms: at(0.5), p99_ms: at(0.99) };
+  }
+}
+
+export function isTraceId(value: unknown): value is string {
+  return typeof value === 'string' && value.length > 0 && value.length <= TRACE_ID_MAX;
+}
+
+/**
+ * Trazas de los comandos en curso y percentiles por tramo. Cada proceso del
+ * relay sólo ve los tramos que pasan por él.
+ */
+export class CommandTraces {
+  private pending: Map<string, PendingTrace> = new Map();
+  private hops: Map<Hop, HopWindow> = new Map(HOPS.map(hop => [hop, new HopWindow()]));
+
+  /** Comando recibido de un panel */
+  public received(id: string) {
+    if (this.pending.size >= MAX_PENDING) {
+      this.pending.delete(this.pending.keys().next().value as string);
+    }
+    this.pending.set(id, { relayIn: performance.now() });
+  }
+
+  /** Comando escrito hacia el dispositivo (sale de la ventana de CommandPipeline) */
+  public sent(id: string) {
+    const trace = this.pending.get(id);
+    if (trace && trace.relayOut === undefined) {
+      trace.relayOut = performance.now();
+      if (trace.relayIn !== undefined) {
+        this.add('relay_queue', trace.relayOut - trace.relayIn);
+      }
+    }
+  }
+
+  /** Confirmación del dispositivo con sus tiempos locales (µs) */
+  public confirmed(id: string, applyUs: unknown, totalUs: unknown) {
+    const trace = this.pending.get(id);
+    if (!trace || typeof applyUs !== 'number' || typeof totalUs !== 'number') {
+      return;
+    }
+    trace.ackIn = performance.now();
+    this.add('device_apply', applyUs / 1000);
+    this.add('device_confirm', Math.max(0, totalUs - applyUs) / 1000);
+    if (trace.relayOut !== undefined) {
+      this.add('device_network', Math.max(0, trace.ackIn - trace.relayOut - totalUs / 1000));
+    }
+  }
+
+  /** Confirmación entregada a las colas de los paneles */
+  public broadcast(id: string) {
+    const trace = this.pending.get(id);
+    if (trace && trace.ackIn !== undefined) {
+      trace.broadcastAt = performance.now();
+      this.add('relay_broadcast', trace.broadcastAt - trace.ackIn);
+    }
+  }
+
+  /** Informe del panel tras pintar la confirmación: cierra la traza */
+  public reported(id: string, totalMs: unknown, renderMs: unknown) {
+    const trace = this.pending.get(id);
+    this.pending.delete(id);
+    if (typeof totalMs !== 'number' || typeof renderMs !== 'number') {
+      return;
+    }
+    this.add('total', totalMs);
+    this.add('frontend_render', renderMs);
+    if (trace && trace.relayIn !== undefined && trace.broadcastAt !== undefined) {
+      this.add('dashboard_network', Math.max(0, totalMs - renderMs - (trace.broadcastAt - trace.relayIn)));
+    }
+  }
+
+  public summary(): Record<string, HopSummary> {
+    const result: Record<string, HopSummary> = {};
+    this.hops.forEach((window, hop) => {
+      result[hop] = window.summary();
+    });
+    return result;
+  }
+
+  private add(hop: Hop, ms: number) {
+    if (Number.isFinite(ms) && ms >= 0) {
+      this.hops.get(hop)!.add(ms);
+    }
+  }
+}
+
+export const commandTraces = new CommandTraces();
+
+gauge('relay_trace_hop_p50_seconds', 'Mediana de cada tramo de los comandos con traza', () =>
+  Object.entries(commandTraces.summary()).map(([hop, s]): [string, number] => [hop, s.p50_ms / 1000]), 'hop');
+gauge('relay_trace_hop_p99_seconds', 'Percentil 99 de cada tramo de los comandos con traza', () =>
+  Object.entries(commandTraces.summary()).map(([hop, s]): [string, number] => [hop, s.p99_ms / 1000]), 'hop');
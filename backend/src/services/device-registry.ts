@@ -0,0 +1,123 @@
+import { DeviceModel, DeviceRecord } from '../models/device.model';
+
+/**
+ * Registro en memoria de los dispositivos, indexado por IP. Se carga una vez
+ * al arrancar y se mantiene al día escribiendo a la vez en memoria y en la
+ * base de datos, así que una reconexión de un dispositivo conocido no hace
+ * ninguna consulta y uno nuevo hace una sola (upsert).
+ */
+export class DeviceRegistry {
+  private byIp: Map<string, DeviceRecord> = new Map();
+  // Altas en curso: conexiones simultáneas de la misma IP comparten la consulta
+  private creating: Map<string, Promise<DeviceRecord>> = new Map();
+  private loaded: Promise<void> | null = null;
+  // Aviso a los demás procesos del relay de los cambios hechos en este (ver RelayBus)
+  private onChange: ((id: number, ip?: string) => void) | null = null;
+
+  public load(): Promise<void> {
+    if (!this.loaded) {
+      this.loaded = DeviceModel.getAllRecords().then(records => {
+        for (const record of records) {
+          this.byIp.set(record.ip, record);
+        }
+        console.log('Registro de dispositivos cargado:', this.byIp.size);
+      }).catch(error => {
+        this.loaded = null;
+        throw error;
+      });
+    }
+    return this.loaded;
+  }
+
+  public get(ip: string): DeviceRecord | undefined {
+    return this.byIp.get(ip);
+  }
+
+  public get size() {
+    return this.byIp.size;
+  }
+
+  /** Devuelve el dispositivo de esa IP, creándolo si no existe */
+  public async ensure(ip: string): Promise<DeviceRecord> {
+    await this.load();
+    const known = this.byIp.get(ip);
+    if (known) {
+      return known;
+    }
+    let pending = this.creating.get(ip);
+    if (!pending) {
+      pending = DeviceModel.upsertByIp({ ip, status: 'unconfigured', type: 'switch', data: { state: 'off' } })
+        .then(record => {
+          this.byIp.set(ip, record);
+          return record;
+        })
+        .finally(() => this.creating.delete(ip));
+      this.creating.set(ip, pending);
+    }
+    return pending;
+  }
+
+  /**
+   * Aplica varios cambios de estado con una sola consulta; los que ya tienen
+   * ese estado en el registro no se escriben. Devuelve las filas escritas,
+   * sin las IP que no están en la base de datos.
+   */
+  public async setStatuses(changes: Map<string, string>): Promise<Array<{ ip: string; status: string }>> {
+    const pending = [...changes]
+      .filter(([ip, status]) => this.byIp.get(ip)?.status !== status)
+      .map(([ip, status]) => ({ ip, status }));
+    if (pending.length === 0) {
+      return [];
+    }
+    const written = await DeviceModel.updateDeviceStatuses(pending);
+    for (const record of written) {
+      this.byIp.set(record.ip, record);
+    }
+    return written.map(({ ip, status }) => ({ ip, status }));
+  }
+
+  /** Publica los cambios de put/removeById para que los demás procesos los invaliden */
+  public shareChanges(publish: (id: number, ip?: string) => void) {
+    this.onChange = publish;
+  }
+
+  /** Mantiene el registro al día con los cambios hechos por la API REST */
+  public put(record: DeviceRecord | undefined) {
+    if (record && record.ip) {
+      // La IP puede haber cambiado: no debe quedar la entrada anterior
+      this.forget(record.id);
+      this.byIp.set(record.ip, {
+        id: record.id, name: record.name, type: record.type, ip: record.ip, status: record.status,
+      });
+      this.onChange?.(record.id, record.ip);
+    }
+  }
+
+  public removeById(id: number) {
+    const ip = this.forget(id);
+    this.onChange?.(id, ip);
+  }
+
+  /**
+   * Cambio hecho por otro proceso: se olvida el dispositivo y la próxima
+   * conexión de esa IP lo vuelve a leer de la base de datos (upsert)
+   */
+  public invalidate(id: number, ip?: string) {
+    this.forget(id);
+    if (ip) {
+      this.byIp.delete(ip);
+    }
+  }
+
+  private forget(id: number): string | undefined {
+    for (const [ip, record] of this.byIp) {
+      if (record.id === id) {
+        this.byIp.delete(ip);
+        return ip;
+      }
+    }
+    return undefined;
+  }
+}
+
+export const deviceRegistry = new DeviceRegistry();
@@ -0,0 +1,135 @@
+import { HistoryModel, HistoryRow } from '../models/history.model';
+
+const DEFAULT_FLUSH_MS = 1000;
+const MAX_BATCH = 5000;          // Con más filas pendientes se escribe sin esperar
+const MAX_PENDING = 50000;       // Si la base de datos no responde se descartan las más antiguas
+const PARTITION_CHECK_MS = 60 * 60 * 1000;
+
+export interface HistoryWriterStats {
+  rowsReceived: number;
+  rowsWritten: number;
+  flushes: number;
+  failures: number;
+  dropped: number;
+  pending: number;
+}
+
+/**
+ * Historial de estados y medidas de salud. Las filas se acumulan y cada
+ * `flushMs` se insertan todas en una sola sentencia (ver
+ * HistoryModel.insertBatch). Al arrancar y cada hora se aseguran las
+ * particiones del día y del siguiente; no se escribe nada hasta tenerlas,
+ * porque una fila en historial_default impide luego crear la de su día.
+ */
+export class HistoryWriter {
+  private pending: HistoryRow[] = [];
+  private timer: NodeJS.Timeout | null = null;
+  private flushing: Promise<void> | null = null;
+  private partitionTimer: NodeJS.Timeout | null = null;
+  // Última creación de particiones: true si ha ido bien
+  private partitionsReady: Promise<boolean> | null = null;
+  private counters: HistoryWriterStats = { rowsReceived: 0, rowsWritten: 0, flushes: 0, failures: 0, dropped: 0, pending: 0 };
+
+  constructor(private flushMs: number = Number(process.env.HISTORY_FLUSH_MS) || DEFAULT_FLUSH_MS) {}
+
+  public start() {
+    const check = () => {
+      this.partitionsReady = this.createPartitions();
+    };
+    check();
+    this.partitionTimer = setInterval(check, PARTITION_CHECK_MS);
+    this.partitionTimer.unref();
+  }
+
+  public record(ip: string, metric: string, value: number) {
+    if (!Number.isFinite(value)) {
+      return;
+    }
+    this.counters.rowsReceived++;
+    this.pending.push({ ts: new Date(), ip, metric, value });
+
+    if (this.pending.length >= MAX_BATCH) {
+      this.flush();
+    } else if (!this.timer) {
+      this.timer = setTimeout(() => this.flush(), this.flushMs);
+    }
+  }
+
+  /** Escribe todo lo pendiente; espera también a una escritura ya en curso */
+  public async flush(): Promise<void> {
+    if (this.timer) {
+      clearTimeout(this.timer);
+      this.timer = null;
+    }
+    while (this.flushing) {
+      await this.flushing;
+    }
+    if (this.pending.length === 0) {
+      return;
+    }
+
+    const rows = this.pending;
+    this.pending = [];
+    this.flushing = this.write(rows).finally(() => {
+      this.flushing = null;
+    });
+    await this.flushing;
+  }
+
+  public async close() {
+    if (this.partitionTimer) {
+      clearInterval(this.partitionTimer);
+      this.partitionTimer = null;
+    }
+    await this.flush();
+  }
+
+  public stats(): HistoryWriterStats {
+    return { ...this.counters, pending: this.pending.length };
+  }
+
+  private createPartitions(): Promise<boolean> {
+    return HistoryModel.ensurePartitions(new Date(), 2).then(
+      () => true,
+      error => {
+        console.error('Error creando particiones del historial:', error);
+        return false;
+      },
+    );
+  }
+
+  private async write(rows: HistoryRow[]) {
+    // Sin particiones (p. ej. la base de datos no estaba lista al arrancar) se
+    // reintenta su creación antes de cada escritura
+    if (!(await (this.partitionsReady ??= this.createPartitions()))) {
+      this.partitionsReady = null;
+      this.counters.failures++;
+      this.requeue(rows);
+      return;
+    }
+    for (let i = 0; i < rows.length; i += MAX_BATCH) {
+      const batch = rows.slice(i, i + MAX_BATCH);
+      try {
+        this.counters.rowsWritten += await HistoryModel.insertBatch(batch);
+        this.counters.flushes++;
+      } catch (error) {
+        this.counters.failures++;
+        console.error('Error escribiendo historial:', error);
+        this.requeue(batch);
+      }
+    }
+  }
+
+  // Devuelve a la cola un lote fallido, delante de las filas más recientes
+  private requeue(batch: HistoryRow[]) {
+    this.pending = batch.concat(this.pending);
+    const excess = this.pending.length - MAX_PENDING;
+    if (excess > 0) {
+      this.pending.splice(0, excess);
+      this.counters.dropped += excess;
+    }
+    if (!this.timer) {
+      this.timer = setTimeout(() => this.flush(), this.flushMs);
+    }
+  }
+}
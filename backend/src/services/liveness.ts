@@ -0,0 +1,131 @@
+import WebSocket from 'ws';
+
+const DEFAULT_TICK_MS = 1000;
+const DEFAULT_IDLE_MS = 20000;   // Silencio tras el que se envía un ping
+const DEFAULT_GRACE_MS = 10000;  // Espera del pong antes de cerrar la conexión
+const WHEEL_SLOTS = 64;
+
+interface Entry {
+  ws: WebSocket;
+  lastSeen: number;              // Tick de la última actividad
+  pingedAt: number | null;       // Tick del ping sin respuesta, si lo hay
+}
+
+/**
+ * Detección de conexiones muertas (incluidas las medio abiertas, que nunca
+ * emiten "close") con una rueda de tiempos: cada conexión está en la ranura
+ * del tick en que toca revisarla y cada tick sólo recorre su ranura. La
+ * actividad sólo anota el tick actual; al revisar una conexión con actividad
+ * reciente se vuelve a colocar en su ranura, sin moverla en cada mensaje.
+ *
+ * Tras `idleMs` sin actividad se envía un ping de WebSocket (los clientes de
+ * los dos firmwares y los navegadores responden solos con un pong); si en
+ * `graceMs` no llega nada la conexión se cierra con terminate(), que emite
+ * "close" como cualquier otra desconexión.
+ */
+export class LivenessWheel {
+  private slots: Set<Entry>[] = Array.from({ length: WHEEL_SLOTS }, () => new Set<Entry>());
+  private entries: Map<WebSocket, { entry: Entry; slot: number }> = new Map();
+  private tickCount = 0;
+  private timer: NodeJS.Timeout | null = null;
+  private idleTicks: number;
+  private graceTicks: number;
+
+  constructor(
+    private onSweep: () => void,
+    private tickMs: number = Number(process.env.LIVENESS_TICK_MS) || DEFAULT_TICK_MS,
+    idleMs: number = Number(process.env.LIVENESS_IDLE_MS) || DEFAULT_IDLE_MS,
+    graceMs: number = Number(process.env.LIVENESS_GRACE_MS) || DEFAULT_GRACE_MS,
+  ) {
+    this.idleTicks = Math.max(1, Math.ceil(idleMs / tickMs));
+    this.graceTicks = Math.max(1, Math.ceil(graceMs / tickMs));
+  }
+
+  public start() {
+    if (!this.timer) {
+      this.timer = setInterval(() => this.tick(), this.tickMs);
+      this.timer.unref();
+    }
+  }
+
+  public stop() {
+    if (this.timer) {
+      clearInterval(this.timer);
+      this.timer = null;
+    }
+  }
+
+  public add(ws: WebSocket) {
+    const entry: Entry = { ws, lastSeen: this.tickCount, pingedAt: null };
+    this.schedule(entry, this.idleTicks);
+  }
+
+  /** Actividad de la conexión (mensaje, ping o pong): O(1), no mueve la entrada */
+  public touch(ws: WebSocket) {
+    const placed = this.entries.get(ws);
+    if (placed) {
+      placed.entry.lastSeen = this.tickCount;
+    }
+  }
+
+  public remove(ws: WebSocket) {
+    const placed = this.entries.get(ws);
+    if (placed) {
+      this.slots[placed.slot].delete(placed.entry);
+      this.entries.delete(ws);
+    }
+  }
+
+  public get size() {
+    return this.entries.size;
+  }
+
+  // Coloca la entrada `ticks` ticks más adelante. Con esperas mayores que la
+  // rueda se coloca en la última ranura y se vuelve a calcular al revisarla.
+  private schedule(entry: Entry, ticks: number) {
+    const ahead = Math.min(Math.max(1, ticks), WHEEL_SLOTS - 1);
+    const slot = (this.tickCount + ahead) % WHEEL_SLOTS;
+    this.slots[slot].add(entry);
+    this.entries.set(entry.ws, { entry, slot });
+  }
+
+  private tick() {
+    this.tickCount++;
+    const slot = this.tickCount % WHEEL_SLOTS;
+    const due = this.slots[slot];
+    this.slots[slot] = new Set();
+
+    for (const entry of due) {
+      this.check(entry);
+    }
+    this.onSweep();
+  }
+
+  private check(entry: Entry) {
+    const now = this.tickCount;
+    if (entry.pingedAt !== null && entry.lastSeen >= entry.pingedAt) {
+      entry.pingedAt = null;  // Ha respondido (o enviado algo) tras el ping
+    }
+
+    if (entry.pingedAt === null) {
+      const idleUntil = entry.lastSeen + this.idleTicks;
+      if (idleUntil > now) {
+        this.schedule(entry, idleUntil - now);
+        return;
+      }
+      if (entry.ws.readyState === WebSocket.OPEN) {
+        entry.pingedAt = now;
+        entry.ws.ping();
+        this.schedule(entry, this.graceTicks);
+        return;
+      }
+    } else if (entry.pingedAt + this.graceTicks > now) {
+      this.schedule(entry, entry.pingedAt + this.graceTicks - now);
+      return;
+    }
+
+    // Sin respuesta: se da por muerta. El "close" de terminate() la retira.
+    this.entries.delete(entry.ws);
+    entry.ws.terminate();
+  }
+}
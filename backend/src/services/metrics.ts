@@ -0,0 +1,166 @@
+import { monitorEventLoopDelay, PerformanceObserver } from 'perf_hooks';
+
+/**
+ * Métricas del relay en formato de texto de Prometheus (GET /metrics).
+ * Sólo contadores e histogramas con cubetas fijas: registrar una medida es
+ * una búsqueda en un Map y unas sumas, sin reservar memoria.
+ */
+
+type Collector = () => string;
+
+const collectors: Collector[] = [];
+// Etiqueta de todas las series, p. ej. worker="2" con varios procesos del relay
+let commonLabel = '';
+
+function escapeLabel(value: string) {
+  return value.replace(/\\/g, '\\\\').replace(/\n/g, '\\n').replace(/"/g, '\\"');
+}
+
+function header(name: string, help: string, type: string) {
+  return `# HELP ${name} ${help}\n# TYPE ${name} ${type}\n`;
+}
+
+/** Contador con una sola etiqueta (p. ej. type="state_update") */
+export class Counter {
+  private values: Map<string, number> = new Map();
+
+  constructor(private name: string, private help: string, private label: string) {
+    collectors.push(() => this.render());
+  }
+
+  public inc(labelValue: string, amount = 1) {
+    this.values.set(labelValue, (this.values.get(labelValue) ?? 0) + amount);
+  }
+
+  private render() {
+    let out = header(this.name, this.help, 'counter');
+    this.values.forEach((value, labelValue) => {
+      out += `${this.name}{${this.label}="${escapeLabel(labelValue)}"} ${value}\n`;
+    });
+    return out;
+  }
+}
+
+interface Series {
+  counts: Float64Array;  // Una cubeta por límite más la de +Inf
+  sum: number;
+  count: number;
+}
+
+/** Histograma con cubetas fijas y, opcionalmente, una etiqueta */
+export class Histogram {
+  private series: Map<string, Series> = new Map();
+
+  constructor(private name: string, private help: string, private buckets: number[], private label?: string) {
+    collectors.push(() => this.render());
+  }
+
+  public observe(value: number, labelValue = '') {
+    let series = this.series.get(labelValue);
+    if (!series) {
+      series = { counts: new Float64Array(this.buckets.length + 1), sum: 0, count: 0 };
+      this.series.set(labelValue, series);
+    }
+    let i = 0;
+    while (i < this.buckets.length && value > this.buckets[i]) {
+      i++;
+    }
+    series.counts[i]++;
+    series.sum += value;
+    series.count++;
+  }
+
+  /** Cronómetro en segundos: llamar a la función devuelta al terminar */
+  public startTimer(labelValue = '') {
+    const start = process.hrtime.bigint();
+    return () => this.observe(Number(process.hrtime.bigint() - start) / 1e9, labelValue);
+  }
+
+  private render() {
+    let out = header(this.name, this.help, 'histogram');
+    this.series.forEach((series, labelValue) => {
+      const own = this.label ? `${this.label}="${escapeLabel(labelValue)}",` : '';
+      const plain = this.label ? `{${this.label}="${escapeLabel(labelValue)}"}` : '';
+      let cumulative = 0;
+      this.buckets.forEach((bound, i) => {
+        cumulative += series.counts[i];
+        out += `${this.name}_bucket{${own}le="${bound}"} ${cumulative}\n`;
+      });
+      out += `${this.name}_bucket{${own}le="+Inf"} ${series.count}\n`;
+      out += `${this.name}_sum${plain} ${series.sum}\n`;
+      out += `${this.name}_count${plain} ${series.count}\n`;
+    });
+    return out;
+  }
+}
+
+/**
+ * Valores que se leen en el momento de la consulta (conexiones, colas...).
+ * `read` devuelve pares [valor de la etiqueta, valor] o un número suelto.
+ */
+export function gauge(name: string, help: string, read: () => number | Array<[string, number]>, label?: string) {
+  collectors.push(() => {
+    let out = header(name, help, 'gauge');
+    const value = read();
+    if (typeof value === 'number') {
+      out += `${name} ${value}\n`;
+    } else {
+      value.forEach(([labelValue, v]) => {
+        out += `${name}{${label}="${escapeLabel(labelValue)}"} ${v}\n`;
+      });
+    }
+    return out;
+  });
+}
+
+/** Añade `name="value"` a todas las series de este proceso */
+export function setCommonLabel(name: string, value: string) {
+  commonLabel = `${name}="${escapeLabel(value)}"`;
+}
+
+/** Texto completo para GET /metrics */
+export function renderMetrics(): string {
+  const text = collectors.map(collect => collect()).join('');
+  if (!commonLabel) {
+    return text;
+  }
+  // Las líneas de las series empiezan por el nombre; las de # HELP/# TYPE no cambian
+  return text.replace(/^([a-zA-Z_:][\w:]*)(\{?)/gm, (_, name, brace) =>
+    brace ? `${name}{${commonLabel},` : `${name}{${commonLabel}}`);
+}
+
+// --- Métricas comunes del relay ---
+
+export const messagesIn = new Counter('relay_messages_in_total', 'Mensajes recibidos por tipo', 'type');
+export const messagesOut = new Counter('relay_messages_out_total', 'Mensajes enviados por tipo (uno por destinatario)', 'type');
+export const fanout = new Histogram('relay_fanout_size', 'Destinatarios de cada publicación',
+  [0, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000]);
+export const dbQueryDuration = new Histogram('relay_db_query_duration_seconds', 'Duración de las consultas por método del modelo (DeviceModel.findByIp...)',
+  [0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5], 'method');
+const gcDuration = new Histogram('nodejs_gc_duration_seconds', 'Pausas del recolector de basura por tipo',
+  [0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25], 'kind');
+
+// Retardo del bucle de eventos desde la consulta anterior (se reinicia en cada
+// una). Las muestras incluyen el periodo de muestreo, que se descuenta.
+const LOOP_RESOLUTION_MS = 10;
+const loopDelay = monitorEventLoopDelay({ resolution: LOOP_RESOLUTION_MS });
+loopDelay.enable();
+collectors.push(() => {
+  const name = 'nodejs_eventloop_lag_seconds';
+  const lag = (ns: number) => Math.max(0, (ns || 0) / 1e6 - LOOP_RESOLUTION_MS) / 1000;
+  let out = header(name, 'Retardo del bucle de eventos desde la consulta anterior', 'gauge');
+  out += `${name}{stat="p50"} ${lag(loopDelay.percentile(50))}\n`;
+  out += `${name}{stat="p99"} ${lag(loopDelay.percentile(99))}\n`;
+  out += `${name}{stat="max"} ${lag(loopDelay.max)}\n`;
+  out += `${name}{stat="mean"} ${lag(loopDelay.mean)}\n`;
+  loopDelay.reset();
+  return out;
+});
+
+const GC_KINDS: Record<number, string> = { 1: 'minor', 2: 'major', 4: 'incremental', 8: 'weakcb' };
+new PerformanceObserver(list => {
+  for (const entry of list.getEntries()) {
+    const kind = (entry as any).detail?.kind ?? (entry as any).kind;
+    gcDuration.observe(entry.duration / 1000, GC_KINDS[kind] ?? String(kind));
+  }
+}).observe({ entryTypes: ['gc'] });
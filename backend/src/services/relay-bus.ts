@@ -0,0 +1,129 @@
+import { Client } from 'pg';
+import { hostname } from 'os';
+import { dbConfig } from '../config/db';
+
+const CHANNEL = 'relay';
+const MAX_PAYLOAD = 7900;       // NOTIFY admite hasta 8000 bytes
+const RECONNECT_MS = 1000;
+
+/** Mensajes que se reparten entre procesos del relay */
+export type BusMessage =
+  // Mensaje para los paneles suscritos a alguno de los temas
+  | { t: 'pub'; topics: string[]; payload: string; key?: string; type?: string }
+  // Comando para el proceso que tenga conectado su dispositivo ("ip" o "identifier")
+  | { t: 'cmd'; command: any }
+  // Dispositivo cambiado o borrado por la API REST en otro proceso (ver DeviceRegistry)
+  | { t: 'registry'; id: number; ip?: string };
+
+/** Con varios procesos (RELAY_WORKERS) o varios hosts (RELAY_BUS=1) */
+export function relayBusEnabled() {
+  return process.env.RELAY_BUS === '1';
+}
+
+/**
+ * Reparto entre procesos y hosts del relay con LISTEN/NOTIFY de Postgres.
+ * Los mensajes de una misma vuelta del bucle de eventos se agrupan en el
+ * menor número de NOTIFY posible; cada proceso ignora los suyos.
+ */
+export class RelayBus {
+  private client: Client | null = null;
+  private outbox: BusMessage[] = [];
+  private scheduled = false;
+  private origin = `${hostname()}:${process.pid}`;
+
+  constructor(private onMessage: (message: BusMessage) => void) {}
+
+  public async start() {
+    const client = new Client(dbConfig);
+    client.on('notification', notification => this.receive(notification.payload));
+    client.on('error', error => {
+      console.error('Error en el bus del relay:', error);
+      this.restart(client);
+    });
+    client.on('end', () => this.restart(client));
+    try {
+      await client.connect();
+      await client.query(`LISTEN ${CHANNEL}`);
+      this.client = client;
+      console.log('Bus del relay conectado:', this.origin);
+    } catch (error) {
+      console.error('No se pudo conectar el bus del relay:', error);
+      this.restart(client);
+    }
+  }
+
+  public publish(message: BusMessage) {
+    if (!this.client) {
+      return;
+    }
+    this.outbox.push(message);
+    if (!this.scheduled) {
+      this.scheduled = true;
+      setImmediate(() => this.flush());
+    }
+  }
+
+  private flush() {
+    this.scheduled = false;
+    const client = this.client;
+    const messages = this.outbox;
+    this.outbox = [];
+    if (!client) {
+      return;
+    }
+
+    let batch: string[] = [];
+    let size = 0;
+    const send = () => {
+      if (batch.length > 0) {
+        const payload = `{"o":${JSON.stringify(this.origin)},"m":[${batch.join(',')}]}`;
+        client.query('SELECT pg_notify($1, $2)', [CHANNEL, payload]).catch(error => {
+          console.error('Error publicando en el bus del relay:', error);
+        });
+      }
+      batch = [];
+      size = 0;
+    };
+
+    for (const message of messages) {
+      const encoded = JSON.stringify(message);
+      if (encoded.length + this.origin.length + 16 > MAX_PAYLOAD) {
+        console.warn('Mensaje demasiado grande para el bus del relay:', message.t);
+        continue;
+      }
+      if (size + encoded.length + this.origin.length + 16 > MAX_PAYLOAD) {
+        send();
+      }
+      batch.push(encoded);
+      size += encoded.length + 1;
+    }
+    send();
+  }
+
+  private receive(payload: string | undefined) {
+    if (!payload) {
+      return;
+    }
+    try {
+      const { o, m } = JSON.parse(payload);
+      if (o === this.origin) {
+        return;
+      }
+      for (const message of m) {
+        this.onMessage(message);
+      }
+    } catch (error) {
+      console.error('Mensaje del bus no válido:', error);
+    }
+  }
+
+  private restart(client: Client) {
+    if (this.client !== client && this.client !== null) {
+      return;
+    }
+    this.client = null;
+    client.removeAllListeners();
+    client.end().catch(() => undefined);
+    setTimeout(() => this.start(), RECONNECT_MS);
+  }
+}
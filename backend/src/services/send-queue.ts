@@ -0,0 +1,221 @@
+import WebSocket from 'ws';
+import { gauge, messagesOut } from './metrics';
+
+const HIGH_WATER_BYTES = Number(process.env.SEND_HIGH_WATER) || 256 * 1024;
+const MAX_QUEUED_BYTES = Number(process.env.SEND_MAX_QUEUED) || 1024 * 1024;
+const MAX_STALL_MS = Number(process.env.SEND_MAX_STALL_MS) || 15000;
+// Con mensajes en cola, cada cuánto se mira si el socket ha bajado de HIGH_WATER_BYTES
+const DRAIN_POLL_MS = 10;
+
+/**
+ * Mensaje serializado y codificado una sola vez para enviarlo a muchas
+ * conexiones. ws no copia un Buffer al enmarcarlo en el servidor (sin máscara
+ * ni compresión): cada conexión sólo añade su cabecera de trama y todas
+ * escriben el mismo payload.
+ */
+export class PreparedMessage {
+  public readonly payload: Buffer;
+
+  constructor(data: string | Buffer, public readonly binary = false) {
+    this.payload = typeof data === 'string' ? Buffer.from(data) : data;
+  }
+}
+
+type Outgoing = string | Buffer | PreparedMessage;
+
+interface QueuedMessage {
+  data: Outgoing;
+  binary: boolean;
+  key?: string;
+  bytes: number;
+}
+
+export interface SendQueueStats {
+  queuedBytes: number;   // Bytes en la cola propia (sin contar bufferedAmount)
+  bufferedBytes: number; // Bytes aceptados por ws pendientes de escribir al socket
+  sent: number;
+  coalesced: number;     // Mensajes sustituidos por uno más reciente de la misma clave
+  dropped: number;
+}
+
+export interface SendOptions {
+  binary?: boolean;
+  // Mensajes con la misma clave se sustituyen mientras esperan en la cola
+  // (p. ej. "state_update:192.168.1.6:led_1": sólo interesa el último estado)
+  key?: string;
+  // Tipo del mensaje, sólo para las métricas
+  type?: string;
+}
+
+function byteLength(data: Outgoing) {
+  if (data instanceof PreparedMessage) {
+    return data.payload.length;
+  }
+  return typeof data === 'string' ? Buffer.byteLength(data) : data.length;
+}
+
+/**
+ * Cola de salida acotada de una conexión. Mientras el socket tiene menos de
+ * HIGH_WATER_BYTES sin escribir los mensajes pasan directamente; por encima
+ * esperan en la cola, donde los de la misma clave se sustituyen por el más
+ * reciente. Una conexión que supera MAX_QUEUED_BYTES o no avanza en
+ * MAX_STALL_MS se cierra.
+ *
+ * Los envíos no llevan callback de escritura: con 1000 paneles el callback
+ * de cada ws.send costaba más CPU que el propio envío (bench/fanout-cpu.mjs).
+ * Sólo las conexiones con cola comprueban el socket cada DRAIN_POLL_MS.
+ */
+export class SendQueue {
+  private static live: Set<SendQueue> = new Set();
+  private static byClient: WeakMap<WebSocket, SendQueue> = new WeakMap();
+
+  private queue: QueuedMessage[] = [];
+  private byKey: Map<string, QueuedMessage> = new Map();
+  private queuedBytes = 0;
+  private stalledSince = 0;
+  private drainTimer?: NodeJS.Timeout;
+  private counters = { sent: 0, coalesced: 0, dropped: 0 };
+
+  private constructor(private ws: WebSocket) {
+    ws.once('close', () => {
+      SendQueue.live.delete(this);
+      clearTimeout(this.drainTimer);
+      this.counters.dropped += this.queue.length;
+      this.queue = [];
+      this.byKey.clear();
+      this.queuedBytes = 0;
+    });
+  }
+
+  public static for(ws: WebSocket): SendQueue {
+    let queue = SendQueue.byClient.get(ws);
+    if (!queue) {
+      queue = new SendQueue(ws);
+      SendQueue.byClient.set(ws, queue);
+      SendQueue.live.add(queue);
+    }
+    return queue;
+  }
+
+  /** Colas de las conexiones abiertas, para las métricas */
+  public static all(): Iterable<SendQueue> {
+    return SendQueue.live;
+  }
+
+  public send(data: Outgoing, options: SendOptions = {}) {
+    messagesOut.inc(options.type ?? 'other');
+    if (this.ws.readyState !== WebSocket.OPEN) {
+      this.counters.dropped++;
+      return;
+    }
+    if (this.queue.length === 0 && this.ws.bufferedAmount < HIGH_WATER_BYTES) {
+      this.write(data, options.binary ?? false);
+      return;
+    }
+
+    const bytes = byteLength(data);
+    const existing = options.key !== undefined ? this.byKey.get(options.key) : undefined;
+    if (existing) {
+      this.queuedBytes += bytes - existing.bytes;
+      existing.data = data;
+      existing.bytes = bytes;
+      this.counters.coalesced++;
+    } else {
+      const message: QueuedMessage = { data, binary: options.binary ?? false, key: options.key, bytes };
+      this.queue.push(message);
+      if (message.key !== undefined) {
+        this.byKey.set(message.key, message);
+      }
+      this.queuedBytes += bytes;
+    }
+
+    if (this.stalledSince === 0) {
+      this.stalledSince = Date.now();
+    }
+    this.scheduleDrain();
+    if (this.queuedBytes > MAX_QUEUED_BYTES || Date.now() - this.stalledSince > MAX_STALL_MS) {
+      console.warn('Conexión demasiado lenta, cerrando. Bytes en cola:', this.queuedBytes);
+      this.ws.terminate();
+    }
+  }
+
+  public stats(): SendQueueStats {
+    return {
+      queuedBytes: this.queuedBytes,
+      bufferedBytes: this.ws.bufferedAmount,
+      ...this.counters,
+    };
+  }
+
+  private write(data: Outgoing, binary: boolean) {
+    this.counters.sent++;
+    if (data instanceof PreparedMessage) {
+      // Un Buffer con binary: false sale como trama de texto sin volver a codificarlo
+      this.ws.send(data.payload, { binary: data.binary });
+      return;
+    }
+    this.ws.send(data, { binary });
+  }
+
+  private scheduleDrain() {
+    if (!this.drainTimer) {
+      this.drainTimer = setTimeout(() => {
+        this.drainTimer = undefined;
+        this.drain();
+      }, DRAIN_POLL_MS);
+    }
+  }
+
+  private drain() {
+    while (this.queue.length > 0 && this.ws.readyState === WebSocket.OPEN &&
+           this.ws.bufferedAmount < HIGH_WATER_BYTES) {
+      const message = this.queue.shift()!;
+      if (message.key !== undefined) {
+        this.byKey.delete(message.key);
+      }
+      this.queuedBytes -= message.bytes;
+      this.write(message.data, message.binary);
+    }
+    if (this.queue.length === 0) {
+      this.stalledSince = 0;
+    } else if (this.ws.readyState === WebSocket.OPEN) {
+      if (Date.now() - this.stalledSince > MAX_STALL_MS) {
+        console.warn('Conexión sin avanzar, cerrando. Bytes en cola:', this.queuedBytes);
+        this.ws.terminate();
+        return;
+      }
+      this.scheduleDrain();
+    }
+  }
+}
+
+// Bytes pendientes por conexión, leídos en cada consulta de /metrics
+gauge('relay_socket_buffered_bytes', 'Bytes pendientes de escribir por conexión (bufferedAmount + cola)', () => {
+  const pending: number[] = [];
+  for (const queue of SendQueue.all()) {
+    const { queuedBytes, bufferedBytes } = queue.stats();
+    pending.push(queuedBytes + bufferedBytes);
+  }
+  pending.sort((a, b) => a - b);
+  const at = (q: number) => (pending.length ? pending[Math.min(pending.length - 1, Math.floor(q * pending.length))] : 0);
+  return [
+    ['sum', pending.reduce((total, bytes) => total + bytes, 0)],
+    ['p50', at(0.5)],
+    ['p99', at(0.99)],
+    ['max', pending.length ? pending[pending.length - 1] : 0],
+  ];
+}, 'stat');
+gauge('relay_sockets_over_high_water', 'Conexiones con mensajes esperando en su cola', () => {
+  let count = 0;
+  for (const queue of SendQueue.all()) {
+    if (queue.stats().queuedBytes > 0) {
+      count++;
+    }
+  }
+  return count;
+});
+
+/** Envía por la cola acotada de la conexión */
+export function sendQueued(ws: WebSocket, data: Outgoing, options?: SendOptions) {
+  SendQueue.for(ws).send(data, options);
+}
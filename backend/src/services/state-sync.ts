@@ -0,0 +1,39 @@
+import WebSocket from 'ws';
+import { sendQueued } from './send-queue';
+
+const ACK_DELAY_MS = 500;
+
+/**
+ * Versiones del diario de estado de cada dispositivo. Los mensajes con
+ * "version" se confirman con un único state_ack agrupado, y tras una
+ * reconexión el dispositivo envía sólo los cambios desde esa versión.
+ */
+export class StateSync {
+  private versions: Map<string, number> = new Map();
+  private ackTimers: Map<string, NodeJS.Timeout> = new Map();
+
+  public knows(ip: string) {
+    return this.versions.has(ip);
+  }
+
+  public record(ip: string, ws: WebSocket, version: number) {
+    const known = this.versions.get(ip);
+    if (known === undefined || version > known) {
+      this.versions.set(ip, version);
+    }
+    if (this.ackTimers.has(ip)) {
+      return;
+    }
+    this.ackTimers.set(ip, setTimeout(() => {
+      this.ackTimers.delete(ip);
+      if (ws.readyState === WebSocket.OPEN) {
+        sendQueued(ws, JSON.stringify({ type: 'state_ack', version: this.versions.get(ip) }), { key: 'state_ack', type: 'state_ack' });
+      }
+    }, ACK_DELAY_MS));
+  }
+
+  /** Tras reiniciar el dispositivo sus versiones vuelven a empezar */
+  public reset(ip: string) {
+    this.versions.delete(ip);
+  }
+}
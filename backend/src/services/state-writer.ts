@@ -0,0 +1,99 @@
+import { DeviceModel, DeviceStateRow } from '../models/device.model';
+
+const DEFAULT_FLUSH_MS = 250;
+const MAX_PENDING = 2000;      // Con más dispositivos pendientes se escribe sin esperar
+const MAX_ROWS_PER_QUERY = 500;
+
+export interface StateWriterStats {
+  updatesReceived: number;  // Cambios de estado notificados
+  rowsWritten: number;      // Filas actualizadas en la base de datos
+  flushes: number;
+  failures: number;
+  pending: number;
+}
+
+/**
+ * Escritura diferida del estado de las salidas. Los cambios se agrupan por
+ * dispositivo (gana el último de cada salida) y cada `flushMs` se escriben
+ * todos con un único UPDATE multi-fila, así que ningún cambio tarda más de
+ * ese intervalo (más la duración de la consulta) en llegar a la base de datos.
+ */
+export class StateWriter {
+  private pending: Map<string, DeviceStateRow> = new Map();
+  private timer: NodeJS.Timeout | null = null;
+  private flushing: Promise<void> | null = null;
+  private counters: StateWriterStats = { updatesReceived: 0, rowsWritten: 0, flushes: 0, failures: 0, pending: 0 };
+
+  constructor(private flushMs: number = Number(process.env.STATE_FLUSH_MS) || DEFAULT_FLUSH_MS) {}
+
+  public record(ip: string, identifier: string, state: 'on' | 'off') {
+    this.counters.updatesReceived++;
+    let row = this.pending.get(ip);
+    if (!row) {
+      row = { ip, state, states: {} };
+      this.pending.set(ip, row);
+    }
+    row.state = state;
+    row.states[identifier] = state;
+
+    if (this.pending.size >= MAX_PENDING) {
+      this.flush();
+    } else if (!this.timer) {
+      this.timer = setTimeout(() => this.flush(), this.flushMs);
+    }
+  }
+
+  /** Escribe todo lo pendiente; espera también a una escritura ya en curso */
+  public async flush(): Promise<void> {
+    if (this.timer) {
+      clearTimeout(this.timer);
+      this.timer = null;
+    }
+    while (this.flushing) {
+      await this.flushing;
+    }
+    if (this.pending.size === 0) {
+      return;
+    }
+
+    const rows = [...this.pending.values()];
+    this.pending = new Map();
+    this.flushing = this.write(rows).finally(() => {
+      this.flushing = null;
+    });
+    await this.flushing;
+  }
+
+  public stats(): StateWriterStats {
+    return { ...this.counters, pending: this.pending.size };
+  }
+
+  private async write(rows: DeviceStateRow[]) {
+    for (let i = 0; i < rows.length; i += MAX_ROWS_PER_QUERY) {
+      const batch = rows.slice(i, i + MAX_ROWS_PER_QUERY);
+      try {
+        this.counters.rowsWritten += await DeviceModel.updateDeviceStates(batch);
+        this.counters.flushes++;
+      } catch (error) {
+        this.counters.failures++;
+        console.error('Error escribiendo estados:', error);
+        this.requeue(batch);
+      }
+    }
+  }
+
+  // Devuelve a la cola un lote fallido sin pisar cambios más recientes
+  private requeue(batch: DeviceStateRow[]) {
+    for (const row of batch) {
+      const newer = this.pending.get(row.ip);
+      if (newer) {
+        newer.states = { ...row.states, ...newer.states };
+      } else {
+        this.pending.set(row.ip, row);
+      }
+    }
+    if (!this.timer) {
+      this.timer = setTimeout(() => this.flush(), this.flushMs);
+    }
+  }
+}
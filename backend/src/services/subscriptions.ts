@@ -0,0 +1,60 @@
+import WebSocket from 'ws';
+
+/** Tema comodín: recibe las actualizaciones de todos los dispositivos */
+export const ALL_TOPICS = '*';
+
+/**
+ * Tabla de suscripciones de los paneles, indexada por tema (identificador de
+ * salida, p. ej. "led_1") y por conexión, para encontrar los destinatarios de
+ * una actualización sin recorrer todas las conexiones.
+ */
+export class SubscriptionTable {
+  private byTopic: Map<string, Set<WebSocket>> = new Map();
+  private byClient: Map<WebSocket, Set<string>> = new Map();
+
+  public subscribe(ws: WebSocket, topics: string[]) {
+    let own = this.byClient.get(ws);
+    if (!own) {
+      own = new Set();
+      this.byClient.set(ws, own);
+    }
+    for (const topic of topics) {
+      own.add(topic);
+      let clients = this.byTopic.get(topic);
+      if (!clients) {
+        clients = new Set();
+        this.byTopic.set(topic, clients);
+      }
+      clients.add(ws);
+    }
+  }
+
+  public unsubscribe(ws: WebSocket, topics?: string[]) {
+    const own = this.byClient.get(ws);
+    if (!own) {
+      return;
+    }
+    for (const topic of topics ?? [...own]) {
+      own.delete(topic);
+      const clients = this.byTopic.get(topic);
+      if (clients) {
+        clients.delete(ws);
+        if (clients.size === 0) {
+          this.byTopic.delete(topic);
+        }
+      }
+    }
+    if (own.size === 0) {
+      this.byClient.delete(ws);
+    }
+  }
+
+  /** Conexiones suscritas a alguno de los temas o al comodín, sin repetir */
+  public subscribers(topics: Iterable<string>): Set<WebSocket> {
+    const result = new Set<WebSocket>(this.byTopic.get(ALL_TOPICS));
+    for (const topic of topics) {
+      this.byTopic.get(topic)?.forEach(ws => result.add(ws));
+    }
+    return result;
+  }
+}
@@ -2,38 +2,151 @@ import WebSocket from 'ws';
 import { Device } from '../types/device';
 import { DeviceModel } from '../models/device.model';
 import http from 'http';
+import { CommandPipeline } from './command-pipeline';
+import { StateSync } from './state-sync';
+import { ALL_TOPICS, SubscriptionTable } from './subscriptions';
+import { StateWriter } from './state-writer';
+import { HistoryWriter } from './history-writer';
+import { LivenessWheel } from './liveness';
+import { deviceRegistry } from './device-registry';
+import { PreparedMessage, sendQueued, SendOptions } from './send-queue';
+import { BusMessage, RelayBus, relayBusEnabled } from './relay-bus';
+import { fanout, gauge, messagesIn } from './metrics';
+import { commandTraces, isTraceId } from './command-trace';
+
+type ConnectionKind = 'device' | 'dashboard';
+
+// Mensajes que sólo envían los dispositivos: identifican la conexión como tal
+const DEVICE_MESSAGES = new Set(['device_connected', 'state_update', 'state_delta', 'rules_loaded', 'ack', 'health']);
+// Comandos de los paneles para un dispositivo. Llevan su dirección en "ip"
+// (la de /api/devices y device_status); toggle_device sin "ip" va al único
+// dispositivo conectado que anuncia el identificador
+const ROUTED_COMMANDS = ['toggle_device', 'set_many', 'rules'];
+// Tipos que se cuentan por separado en /metrics; el resto cuenta como "other"
+const METRIC_TYPES = new Set([...DEVICE_MESSAGES, ...ROUTED_COMMANDS, 'subscribe', 'unsubscribe', 'trace_report']);
+// Pruebas de carga (ClienteESP/swarm): muchos dispositivos virtuales desde la
+// misma IP, distinguidos por el parámetro ?device= de la URL
+const SIMULATED_DEVICES = process.env.RELAY_SIMULATED_DEVICES === '1';
+
+/** Clave de la conexión: la IP del cliente (o IP/dispositivo en simulación) */
+function connectionKey(req: http.IncomingMessage): string | undefined {
+  const ip = req.socket.remoteAddress;
+  if (SIMULATED_DEVICES && ip) {
+    const device = new URL(req.url ?? '/', 'ws://relay').searchParams.get('device');
+    if (device) {
+      return `${ip}/${device}`;
+    }
+  }
+  return ip;
+}
 
 export class WebSocketService {
   private wss: WebSocket.Server;
   private clients: Map<string, WebSocket> = new Map();
+  private commands = new CommandPipeline();
+  private stateSync = new StateSync();
+  // identificador de salida (led_1...) -> IP de los dispositivos que la anuncian
+  private devicesByIdentifier: Map<string, Set<string>> = new Map();
+  // IP del dispositivo -> identificadores que anuncia (temas de sus mensajes)
+  private identifiersByIp: Map<string, Set<string>> = new Map();
+  private kinds: Map<WebSocket, ConnectionKind> = new Map();
+  private subscriptions = new SubscriptionTable();
+  private stateWriter = new StateWriter();
+  private historyWriter = new HistoryWriter();
+  // Conexiones sin respuesta se cierran; cada barrido escribe los cambios de estado
+  private liveness = new LivenessWheel(() => this.flushPresence());
+  // Cambios de estado de dispositivos pendientes del próximo barrido (IP -> estado)
+  private presence: Map<string, string> = new Map();
+  private presenceFlushing = false;
+  // Reparto a los demás procesos del relay (ver RelayBus); null con uno solo
+  private bus = relayBusEnabled() ? new RelayBus(message => this.onBusMessage(message)) : null;
 
   constructor(server: http.Server) {
     this.wss = new WebSocket.Server({ server });
+    this.registerMetrics();
     this.init();
   }
 
   private init() {
+    this.bus?.start();
+    if (this.bus) {
+      const bus = this.bus;
+      deviceRegistry.shareChanges((id, ip) => bus.publish({ t: 'registry', id, ip }));
+    }
+    this.historyWriter.start();
+    this.liveness.start();
+    this.commands.start();
+
     this.wss.on('connection', (ws: WebSocket, req: http.IncomingMessage) => {
-      const clientIp = req.socket.remoteAddress;
+      const clientIp = connectionKey(req);
       console.log('Nueva conexión WebSocket desde:', clientIp);
       
-      // Registrar el dispositivo si es nuevo
-      this.handleNewDevice(clientIp, ws);
+      // Hasta que se identifique, la conexión es un panel suscrito a todo
+      // (compatibilidad con paneles que no envían "subscribe")
+      this.kinds.set(ws, 'dashboard');
+      this.subscriptions.subscribe(ws, [ALL_TOPICS]);
+
+      this.liveness.add(ws);
+      ws.on('pong', () => this.liveness.touch(ws));
+      ws.on('ping', () => this.liveness.touch(ws));
+
+      ws.on('message', (message: Buffer, isBinary: boolean) => {
+        this.liveness.touch(ws);
+
+        // Tramas binarias de telemetría: sólo a los paneles suscritos al dispositivo
+        if (isBinary) {
+          messagesIn.inc('binary');
+          this.publish(this.topicsOf(clientIp, {}), message, { binary: true, type: 'binary' });
+          return;
+        }
 
-      ws.on('message', (message: Buffer) => {
         try {
           const messageStr = message.toString();
           console.log('Mensaje recibido:', messageStr);
           
           // Verificar que el mensaje es JSON válido
           const data = JSON.parse(messageStr);
-          
-          // Retransmitir el mensaje como string a todos los clientes
-          this.wss.clients.forEach(client => {
-            if (client.readyState === WebSocket.OPEN) {
-              client.send(messageStr);
+          messagesIn.inc(METRIC_TYPES.has(data.type) ? data.type : 'other');
+          this.classify(clientIp, ws, data);
+
+          if (data.type === 'subscribe' || data.type === 'unsubscribe') {
+            this.handleSubscription(ws, data);
+            return;
+          }
+
+          if (data.type === 'health') {
+            this.handleHealth(clientIp, data);
+            return;
+          }
+
+          // Informe de un panel al pintar la confirmación de un comando con traza
+          if (data.type === 'trace_report') {
+            if (isTraceId(data.trace)) {
+              commandTraces.reported(data.trace, data.total_ms, data.render_ms);
+            }
+            return;
+          }
+
+          if (this.kinds.get(ws) === 'device') {
+            this.recordState(clientIp, data);
+          }
+
+          if (this.handleStateSync(clientIp, ws, data) || this.handleCommandFlow(clientIp, ws, data)) {
+            return;
+          }
+
+          // Los mensajes de los dispositivos van sólo a los paneles suscritos;
+          // nunca a otros dispositivos ni de vuelta al emisor
+          if (this.kinds.get(ws) === 'device') {
+            const traced = isTraceId(data.trace);
+            if (traced) {
+              commandTraces.confirmed(data.trace, data.dev_apply_us, data.dev_total_us);
+            }
+            this.publish(this.topicsOf(clientIp, data), messageStr, { key: this.coalesceKey(clientIp, data), type: data.type });
+            if (traced) {
+              commandTraces.broadcast(data.trace);
             }
-          });
+          }
         } catch (error) {
           console.error('Error procesando mensaje:', error);
         }
@@ -41,8 +154,17 @@ export class WebSocketService {
 
       ws.on('close', () => {
         console.log('Cliente desconectado:', clientIp);
+        const wasDevice = this.kinds.get(ws) === 'device';
+        this.liveness.remove(ws);
+        this.kinds.delete(ws);
+        this.subscriptions.unsubscribe(ws);
+        if (!wasDevice || this.clients.get(clientIp) !== ws) {
+          return;
+        }
         this.clients.delete(clientIp);
-        this.updateDeviceStatus(clientIp, 'unconfigured');
+        this.commands.detach(clientIp, ws);
+        // Se escribe y se anuncia en el próximo barrido, junto con el resto
+        this.presence.set(clientIp, 'unconfigured');
       });
 
       ws.on('error', (error) => {
@@ -51,53 +173,333 @@ export class WebSocketService {
     });
   }
 
-  private async handleNewDevice(ip: string, ws: WebSocket) {
-    this.clients.set(ip, ws);
-    
-    // Buscar o crear dispositivo en la base de datos
-    let device = await DeviceModel.findByIp(ip);
-    if (!device) {
-      device = await DeviceModel.createDevice({
-        ip,
-        status: 'unconfigured',
-        type: 'switch',
-        data: { state: 'off' }
+  /** Conexiones por tipo y escritura de estados, leídas en cada consulta de /metrics */
+  private registerMetrics() {
+    gauge('relay_connections', 'Conexiones abiertas por tipo', () => {
+      let devices = 0;
+      this.kinds.forEach(kind => {
+        if (kind === 'device') {
+          devices++;
+        }
       });
+      return [['device', devices], ['dashboard', this.kinds.size - devices]];
+    }, 'kind');
+    gauge('relay_state_writer', 'Contadores de la escritura de estados por lotes', () =>
+      Object.entries(this.stateWriter.stats()), 'stat');
+    gauge('relay_history_writer', 'Contadores de la escritura del historial', () =>
+      Object.entries(this.historyWriter.stats()), 'stat');
+    gauge('relay_command_pipeline', 'Comandos reenviados y descartados por falta de confirmación', () =>
+      Object.entries(this.commands.stats()), 'stat');
+  }
+
+  /** Una conexión pasa a ser dispositivo al enviar su primer mensaje propio */
+  private classify(ip: string, ws: WebSocket, data: any) {
+    if (this.kinds.get(ws) !== 'device' && DEVICE_MESSAGES.has(data.type)) {
+      this.kinds.set(ws, 'device');
+      this.subscriptions.unsubscribe(ws);
+      // Registrar el dispositivo si es nuevo (los paneles no se registran)
+      this.handleNewDevice(ip, ws);
     }
   }
 
-  private async handleMessage(ip: string, data: any) {
-    if (data.type === 'state_update') {
-      await DeviceModel.updateDeviceState(ip, data.state);
-      this.broadcastToFrontend({
-        type: 'device_update',
-        ip,
-        state: data.state
-      });
+  /** {"type":"subscribe","topics":["led_1","led_2"]} sustituye las suscripciones del panel */
+  private handleSubscription(ws: WebSocket, data: any) {
+    if (this.kinds.get(ws) !== 'dashboard' || !Array.isArray(data.topics)) {
+      return;
+    }
+    const topics = data.topics.filter((t: unknown) => typeof t === 'string');
+    if (data.type === 'subscribe') {
+      this.subscriptions.unsubscribe(ws);
+      this.subscriptions.subscribe(ws, topics);
+    } else {
+      this.subscriptions.unsubscribe(ws, topics);
+    }
+  }
+
+  /** Temas de un mensaje de dispositivo: su identificador, los del mapa "states" o todos los del dispositivo */
+  private topicsOf(ip: string, data: any): Iterable<string> {
+    if (typeof data.identifier === 'string') {
+      return [data.identifier];
+    }
+    if (data.states && typeof data.states === 'object') {
+      return Object.keys(data.states);
+    }
+    return this.identifiersByIp.get(ip) ?? [];
+  }
+
+  private registerIdentifier(ip: string, identifier: string) {
+    let devices = this.devicesByIdentifier.get(identifier);
+    if (!devices) {
+      devices = new Set();
+      this.devicesByIdentifier.set(identifier, devices);
+    }
+    devices.add(ip);
+    let identifiers = this.identifiersByIp.get(ip);
+    if (!identifiers) {
+      identifiers = new Set();
+      this.identifiersByIp.set(ip, identifiers);
+    }
+    identifiers.add(identifier);
+  }
+
+  /**
+   * Envía a los paneles suscritos a alguno de los temas y, con varios
+   * procesos, a los paneles de los demás. La telemetría binaria no sale del
+   * proceso que la recibe.
+   */
+  private publish(topics: Iterable<string>, payload: string | Buffer, options: SendOptions = {}) {
+    const list = Array.from(topics);
+    this.deliver(list, payload, options);
+    if (this.bus && typeof payload === 'string') {
+      this.bus.publish({ t: 'pub', topics: list, payload, key: options.key, type: options.type });
     }
   }
 
-  private async updateDeviceStatus(ip: string, status: string) {
-    await DeviceModel.updateDeviceStatus(ip, status);
-    this.broadcastToFrontend({
-      type: 'device_status',
-      ip,
-      status
+  /**
+   * Envía sólo a los paneles de este proceso, por su cola acotada. El mensaje
+   * se codifica una vez y todos los destinatarios comparten el mismo payload.
+   */
+  private deliver(topics: Iterable<string>, payload: string | Buffer, options: SendOptions = {}) {
+    const clients = this.subscriptions.subscribers(topics);
+    fanout.observe(clients.size);
+    if (clients.size === 0) {
+      return;
+    }
+    const message = new PreparedMessage(payload, options.binary ?? false);
+    clients.forEach(client => {
+      sendQueued(client, message, options);
     });
   }
 
-  public broadcastToFrontend(data: any) {
-    this.wss.clients.forEach(client => {
-      if (client.readyState === WebSocket.OPEN) {
-        client.send(JSON.stringify(data));
+  /** Mensajes de otros procesos: se entregan aquí sin volver a publicarlos */
+  private onBusMessage(message: BusMessage) {
+    if (message.t === 'pub') {
+      this.deliver(message.topics, message.payload, { key: message.key, type: message.type });
+    } else if (message.t === 'cmd') {
+      const deviceIp = this.commandTarget(message.command);
+      if (deviceIp && this.commands.hasDevice(deviceIp)) {
+        this.commands.send(deviceIp, message.command);
       }
-    });
+    } else if (message.t === 'registry') {
+      deviceRegistry.invalidate(message.id, message.ip);
+    }
+  }
+
+  /**
+   * Clave de sustitución en cola: de cada salida sólo importa el último estado.
+   * Incluye la IP porque dispositivos distintos usan los mismos identificadores.
+   */
+  private coalesceKey(ip: string, data: any): string | undefined {
+    if (data.type === 'state_update' && typeof data.identifier === 'string') {
+      return `state_update:${ip}:${data.identifier}`;
+    }
+    return undefined;
+  }
+
+  /**
+   * Resincronización por versiones. Devuelve true si el mensaje ya se ha
+   * tratado y no debe retransmitirse.
+   */
+  private handleStateSync(ip: string, ws: WebSocket, data: any): boolean {
+    if (data.type === 'device_connected') {
+      // Anuncio completo: el dispositivo ha arrancado o no tenía confirmación
+      this.stateSync.reset(ip);
+    }
+
+    if (data.type === 'state_delta') {
+      if (!this.stateSync.knows(ip)) {
+        // Servidor reiniciado: no sabemos desde qué estado aplicar el delta
+        sendQueued(ws, JSON.stringify({ type: 'resync_request' }), { type: 'resync_request' });
+        return true;
+      }
+      this.commands.attach(ip, ws, data.last_seq);
+      this.stateSync.record(ip, ws, data.version);
+      this.sendClock(ws);
+
+      // Los paneles siguen recibiendo un state_update por salida cambiada
+      for (const [identifier, state] of Object.entries(data.states || {})) {
+        this.registerIdentifier(ip, identifier);
+        this.broadcastToFrontend({ type: 'state_update', identifier, state, ip, version: data.version }, [identifier]);
+      }
+      return true;
+    }
+
+    if (typeof data.version === 'number') {
+      this.stateSync.record(ip, ws, data.version);
+    }
+    return false;
+  }
+
+  /**
+   * Numeración y confirmación de comandos. Devuelve true si el mensaje ya se
+   * ha entregado y no debe retransmitirse a todos los clientes.
+   */
+  private handleCommandFlow(ip: string, ws: WebSocket, data: any): boolean {
+    if (data.type === 'device_connected' && data.identifier) {
+      this.registerIdentifier(ip, data.identifier);
+      this.commands.attach(ip, ws, data.last_seq);
+      this.sendClock(ws);
+      return false;
+    }
+
+    // Las confirmaciones de los dispositivos llevan la "seq" del comando
+    if (typeof data.seq === 'number' && this.commands.hasDevice(ip)) {
+      this.commands.ack(ip, data.seq);
+      return data.type === 'ack';
+    }
+
+    if (ROUTED_COMMANDS.includes(data.type)) {
+      if (isTraceId(data.trace)) {
+        commandTraces.received(data.trace);
+      }
+      const deviceIp = this.commandTarget(data);
+      if (deviceIp && (!this.bus || this.commands.hasDevice(deviceIp))) {
+        this.commands.send(deviceIp, data);
+      } else if (this.bus && (typeof data.ip === 'string' || typeof data.identifier === 'string')) {
+        // El dispositivo puede estar conectado a otro proceso del relay
+        this.bus.publish({ t: 'cmd', command: data });
+      } else {
+        console.warn('Comando para un dispositivo desconocido:', data.ip ?? data.identifier);
+      }
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Dispositivo de este proceso al que va un comando: el de su "ip" (también
+   * sin el prefijo de IPv4 mapeada en IPv6 que lleva la clave de conexión) o,
+   * sin "ip", el único conectado que anuncia su identificador.
+   */
+  private commandTarget(data: any): string | undefined {
+    if (typeof data.ip === 'string') {
+      return [data.ip, `::ffff:${data.ip}`].find(ip => this.identifiersByIp.has(ip) || this.commands.hasDevice(ip));
+    }
+    const devices = typeof data.identifier === 'string' ? this.devicesByIdentifier.get(data.identifier) : undefined;
+    if (!devices) {
+      return undefined;
+    }
+    if (devices.size === 1) {
+      return devices.values().next().value;
+    }
+    const connected = Array.from(devices).filter(ip => this.commands.hasDevice(ip));
+    if (connected.length > 1) {
+      console.warn('Identificador anunciado por varios dispositivos, falta "ip" en el comando:', data.identifier);
+    }
+    return connected.length === 1 ? connected[0] : undefined;
+  }
+
+  /** Guarda la última medida de salud del dispositivo; no se retransmite */
+  private async handleHealth(ip: string, data: any) {
+    const { type, ...health } = data;
+    // Los campos numéricos de primer nivel van al historial como "health.<campo>"
+    for (const [field, value] of Object.entries(health)) {
+      if (typeof value === 'number') {
+        this.historyWriter.record(ip, `health.${field}`, value);
+      }
+    }
+    try {
+      await DeviceModel.updateDeviceHealth(ip, { ...health, received_at: new Date().toISOString() });
+    } catch (error) {
+      console.error('Error guardando salud del dispositivo:', error);
+    }
+  }
+
+  /** Hora local en segundos desde medianoche, para las reglas horarias del dispositivo */
+  private sendClock(ws: WebSocket) {
+    const now = new Date();
+    const seconds = now.getHours() * 3600 + now.getMinutes() * 60 + now.getSeconds();
+    sendQueued(ws, JSON.stringify({ type: 'clock', seconds }), { key: 'clock', type: 'clock' });
+  }
+
+  private async handleNewDevice(ip: string, ws: WebSocket) {
+    this.clients.set(ip, ws);
+    // Reconectado antes del barrido: su desconexión ya no se escribe ni se anuncia
+    this.presence.delete(ip);
+
+    // Buscar o crear dispositivo: en memoria, o un único upsert si es nuevo
+    try {
+      await deviceRegistry.ensure(ip);
+    } catch (error) {
+      console.error('Error registrando dispositivo:', error);
+    }
+  }
+
+  /** Estado de las salidas hacia la base de datos y el historial, por lotes (ver StateWriter) */
+  private recordState(ip: string, data: any) {
+    if (data.type !== 'state_update' && data.type !== 'state_delta') {
+      return;
+    }
+    if (typeof data.identifier === 'string' && (data.state === 'on' || data.state === 'off')) {
+      this.stateWriter.record(ip, data.identifier, data.state);
+      this.historyWriter.record(ip, data.identifier, data.state === 'on' ? 1 : 0);
+    }
+    for (const [identifier, state] of Object.entries(data.states || {})) {
+      if (state === 'on' || state === 'off') {
+        this.stateWriter.record(ip, identifier, state);
+        this.historyWriter.record(ip, identifier, state === 'on' ? 1 : 0);
+      }
+    }
+  }
+
+  /**
+   * Cambios de estado acumulados desde el barrido anterior: una sola
+   * escritura y un único device_status con todos ellos, aunque se caigan
+   * miles de dispositivos a la vez (p. ej. al reiniciar el punto de acceso)
+   */
+  private async flushPresence() {
+    if (this.presence.size === 0 || this.presenceFlushing) {
+      return;
+    }
+    const changes = this.presence;
+    this.presence = new Map();
+    this.presenceFlushing = true;
+    let devices: Array<{ ip: string; status: string }>;
+    try {
+      devices = await deviceRegistry.setStatuses(changes);
+    } catch (error) {
+      console.error('Error actualizando estado de los dispositivos:', error);
+      // Sin anuncio; se reintenta en el próximo barrido salvo que se hayan reconectado
+      changes.forEach((status, ip) => {
+        if (!this.clients.has(ip) && !this.presence.has(ip)) {
+          this.presence.set(ip, status);
+        }
+      });
+      return;
+    } finally {
+      this.presenceFlushing = false;
+    }
+    if (devices.length === 0) {
+      return;
+    }
+
+    // Sólo lo que se ha escrito
+    const topics = new Set<string>();
+    for (const { ip } of devices) {
+      for (const topic of this.topicsOf(ip, {})) {
+        topics.add(topic);
+      }
+    }
+    this.broadcastToFrontend({ type: 'device_status', devices }, topics);
+  }
+
+  public broadcastToFrontend(data: any, topics: Iterable<string> = [ALL_TOPICS]) {
+    this.publish(topics, JSON.stringify(data), { key: this.coalesceKey(data.ip, data), type: data.type });
+  }
+
+  /** Escribe los estados pendientes; para el cierre ordenado del servidor */
+  public async close() {
+    this.liveness.stop();
+    this.commands.stop();
+    await Promise.all([this.stateWriter.flush(), this.historyWriter.close(), this.flushPresence()]);
+    console.log('Estados escritos:', this.stateWriter.stats());
+    console.log('Historial escrito:', this.historyWriter.stats());
   }
 
   public sendToDevice(ip: string, message: any) {
     const client = this.clients.get(ip);
-    if (client && client.readyState === WebSocket.OPEN) {
-      client.send(JSON.stringify(message));
+    if (client) {
+      sendQueued(client, JSON.stringify(message), { type: message.type });
     }
   }
 } 
\ No newline at end of file
@@ -6,6 +6,7 @@ export interface Device {
   status: string;
   data?: {
     state?: 'on' | 'off';
+    health?: Record<string, unknown>;
   };
   created_at?: Date;
   updated_at?: Date;
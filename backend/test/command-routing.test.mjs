@@ -0,0 +1,114 @@
+// Entrega de los comandos de un panel al dispositivo de su "ip", con el
+// WebSocketService real en un servidor HTTP local. Sin Postgres los errores
+// de escritura sólo se registran, así que no hace falta base de datos:
+//
+//   npm run build && npm test
+
+import assert from 'node:assert/strict';
+import http from 'http';
+import { after, before, test } from 'node:test';
+import { createRequire } from 'module';
+import WebSocket from 'ws';
+
+// Varios dispositivos desde 127.0.0.1, distinguidos por ?device= (clave "127.0.0.1/<device>")
+process.env.RELAY_SIMULATED_DEVICES = '1';
+const require = createRequire(import.meta.url);
+const { WebSocketService } = require('../dist/services/websocket.service.js');
+
+let server;
+let service;
+let url;
+const sockets = [];
+
+// Abre una conexión que guarda los mensajes de texto recibidos
+async function open(path = '/') {
+  const ws = new WebSocket(url + path);
+  ws.received = [];
+  ws.on('message', (data, isBinary) => {
+    if (!isBinary) {
+      ws.received.push(JSON.parse(data.toString()));
+      ws.emit('received');
+    }
+  });
+  await new Promise((resolve, reject) => {
+    ws.once('open', resolve);
+    ws.once('error', reject);
+  });
+  sockets.push(ws);
+  return ws;
+}
+
+// Espera al primer mensaje de ese tipo recibido desde `from`
+function next(ws, type, from = 0) {
+  return new Promise((resolve, reject) => {
+    const timer = setTimeout(() => reject(new Error(`sin ${type}`)), 2000);
+    const check = () => {
+      const message = ws.received.slice(from).find(m => m.type === type);
+      if (message) {
+        clearTimeout(timer);
+        ws.off('received', check);
+        resolve(message);
+      }
+    };
+    ws.on('received', check);
+    check();
+  });
+}
+
+// Dispositivo que anuncia las mismas salidas que los demás
+async function device(name) {
+  const ws = await open(`/?device=${name}`);
+  for (const identifier of ['led_1', 'led_2', 'led_3']) {
+    ws.send(JSON.stringify({ type: 'device_connected', identifier, ip: '127.0.0.1' }));
+  }
+  // El relay responde al anuncio con la hora tras asociar la conexión
+  await next(ws, 'clock');
+  return ws;
+}
+
+before(async () => {
+  server = http.createServer();
+  service = new WebSocketService(server);
+  await new Promise(resolve => server.listen(0, '127.0.0.1', resolve));
+  url = `ws://127.0.0.1:${server.address().port}`;
+});
+
+after(async () => {
+  sockets.forEach(ws => ws.terminate());
+  await service.close();
+  await new Promise(resolve => server.close(resolve));
+});
+
+test('set_many y toggle_device llegan sólo al dispositivo de su "ip"', async () => {
+  const a = await device('a');
+  const b = await device('b');
+  const dashboard = await open();
+
+  dashboard.send(JSON.stringify({ type: 'set_many', ip: '127.0.0.1/b', mask: 5, states: 1 }));
+  dashboard.send(JSON.stringify({ type: 'toggle_device', ip: '127.0.0.1/a', identifier: 'led_1', state: 'on' }));
+
+  const setMany = await next(b, 'set_many');
+  assert.equal(setMany.mask, 5);
+  assert.equal(setMany.states, 1);
+  assert.equal(typeof setMany.seq, 'number');
+  const toggle = await next(a, 'toggle_device');
+  assert.equal(toggle.identifier, 'led_1');
+
+  assert.ok(!a.received.some(m => m.type === 'set_many'));
+  assert.ok(!b.received.some(m => m.type === 'toggle_device'));
+});
+
+test('toggle_device sin "ip" no se entrega si varios dispositivos anuncian el identificador', async () => {
+  const a = await device('c');
+  await device('d');
+  const dashboard = await open();
+  const from = a.received.length;
+
+  dashboard.send(JSON.stringify({ type: 'toggle_device', identifier: 'led_2', state: 'on' }));
+  dashboard.send(JSON.stringify({ type: 'toggle_device', ip: '127.0.0.1/c', identifier: 'led_2', state: 'off' }));
+
+  // Los mensajes de un panel se tratan en orden: el primero se ha descartado
+  const toggle = await next(a, 'toggle_device', from);
+  assert.equal(toggle.state, 'off');
+  assert.equal(toggle.ip, '127.0.0.1/c');
+});
@@ -0,0 +1,91 @@
+#pragma once
+
+// Log diferido: las rutas calientes guardan un registro binario (instante,
+// nivel, formato y hasta tres enteros de 32 bits) en una cola y una tarea de
+// baja prioridad lo escribe por Serial cuando hay hueco en el buffer de
+// transmisión. Nunca bloquea: con la cola llena el registro se descarta y se
+// cuenta.
+//
+// Los niveles por encima de LOG_LEVEL se eliminan al compilar. El formato debe
+// ser un literal y los argumentos enteros: se formatea más tarde, así que no se
+// pueden pasar cadenas.
+
+#include <Arduino.h>
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define DLOG_QUEUE_LEN 64
+
+#define DLOG_AT(level, fmt, a, b, c, ...)                                      \
+  do {                                                                         \
+    if ((level) <= LOG_LEVEL) {                                                \
+      dlogWrite((level), (fmt), (uint32_t)(a), (uint32_t)(b), (uint32_t)(c));  \
+    }                                                                          \
+  } while (0)
+
+#define LOGE(fmt, ...) DLOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__, 0, 0, 0)
+#define LOGW(fmt, ...) DLOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__, 0, 0, 0)
+#define LOGI(fmt, ...) DLOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__, 0, 0, 0)
+#define LOGD(fmt, ...) DLOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__, 0, 0, 0)
+
+struct DlogRecord {
+  uint32_t ms;
+  uint8_t level;
+  const char* fmt;
+  uint32_t args[3];
+};
+
+static QueueHandle_t dlogQueue = nullptr;
+static volatile uint32_t dlogDropped = 0;
+
+static void dlogWrite(uint8_t level, const char* fmt, uint32_t a, uint32_t b, uint32_t c) {
+  DlogRecord rec = {(uint32_t)millis(), level, fmt, {a, b, c}};
+  if (dlogQueue == nullptr || xQueueSend(dlogQueue, &rec, 0) != pdTRUE) {
+    dlogDropped++;
+  }
+}
+
+static void dlogDrainTask(void*) {
+  static const char LEVEL_CHARS[] = "-EWID";
+  DlogRecord rec;
+  char line[128];
+  uint32_t reportedDropped = 0;
+
+  while (true) {
+    if (xQueueReceive(dlogQueue, &rec, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    int len = snprintf(line, sizeof(line), "%c (%lu) ", LEVEL_CHARS[rec.level], (unsigned long)rec.ms);
+    len += snprintf(line + len, sizeof(line) - len, rec.fmt, rec.args[0], rec.args[1], rec.args[2]);
+    if (len >= (int)sizeof(line) - 1) {
+      len = sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+
+    // Esperar hueco en el buffer de Serial en lugar de bloquear en write()
+    while (Serial.availableForWrite() < len) {
+      vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    Serial.write((const uint8_t*)line, len);
+
+    uint32_t dropped = dlogDropped;
+    if (dropped != reportedDropped) {
+      Serial.printf("W %lu registros de log descartados\n", (unsigned long)(dropped - reportedDropped));
+      reportedDropped = dropped;
+    }
+  }
+}
+
+// Crea la cola y la tarea de vaciado, en el núcleo 0 para no competir con loop()
+static void dlogBegin() {
+  dlogQueue = xQueueCreate(DLOG_QUEUE_LEN, sizeof(DlogRecord));
+  xTaskCreatePinnedToCore(dlogDrainTask, "dlog", 3072, nullptr, 1, nullptr, 0);
+}
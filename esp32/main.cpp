@@ -1,6 +1,8 @@
 #include <WiFi.h>
 #include <WebSocketsClient.h>
-#include <ArduinoJson.h>
+#include <protocol_core.hpp>  // Librería ../protocol, común con ClienteESP
+#include <Preferences.h>
+#include "deferred_log.h"
 
 // Configuración WiFi
 const char* WIFI_SSID = "Yolymell";
@@ -18,146 +20,421 @@ const int WS_PORT = 80;
 WebSocketsClient webSocket;
 bool isConnected = false;
 
-void handleWebSocketMessage(uint8_t * payload) {
-  StaticJsonDocument<200> doc;
-  DeserializationError error = deserializeJson(doc, payload);
-  
-  if (error) {
-    Serial.println("Error parsing JSON");
+// Supervisor de conexión: avanza desde loop() sin bloquear, así
+// webSocket.loop() se atiende en cada vuelta
+enum LinkState {
+  LINK_WIFI_DOWN,        // Sin WiFi, esperando al siguiente intento
+  LINK_WIFI_CONNECTING,  // WiFi.begin() lanzado, esperando IP
+  LINK_WS_CONNECTING,    // Con IP, la librería intenta el WebSocket
+  LINK_ONLINE            // WebSocket conectado
+};
+
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 10000;
+const unsigned long WIFI_RETRY_MIN_MS = 1000;
+const unsigned long WIFI_RETRY_MAX_MS = 60000;
+const unsigned long ANNOUNCE_SPACING_MS = 100;
+const unsigned long WIFI_FAST_TIMEOUT_MS = 3000;
+
+LinkState linkState = LINK_WIFI_DOWN;
+unsigned long linkStateSince = 0;
+unsigned long wifiRetryDelay = WIFI_RETRY_MIN_MS;
+bool wsStarted = false;
+
+// Última conexión buena (NVS): permite asociarse sin escanear y sin DHCP.
+// Conviene reservar la IP del dispositivo en el router.
+struct WifiCache {
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+Preferences wifiPrefs;
+WifiCache wifiCache;
+bool wifiFastPath = false;
+unsigned long wifiConnectStart = 0;  // Inicio del intento en curso, para el tiempo hasta IP
+bool wifiMeasuring = false;
+
+// Los eventos WiFi llegan desde la tarea del driver: solo se marcan aquí
+volatile bool wifiGotIp = false;
+volatile bool wifiLost = false;
+
+// Anuncios pendientes tras conectar, uno cada ANNOUNCE_SPACING_MS
+const char* const LED_IDS[] = {"led_1", "led_2", "led_3"};
+const int LED_ID_COUNT = sizeof(LED_IDS) / sizeof(LED_IDS[0]);
+int pendingAnnounce = LED_ID_COUNT;
+unsigned long lastAnnounce = 0;
+
+// Medida del periodo de loop(): máximo y p99 por ventana de LOOP_REPORT_MS
+const unsigned long LOOP_REPORT_MS = 10000;
+const unsigned long LOOP_BUCKET_US = 250;
+const int LOOP_BUCKETS = 80;  // El último cubo acumula todo lo que supere 20 ms
+uint32_t loopHistogram[LOOP_BUCKETS];
+uint32_t loopSamples = 0;
+unsigned long loopMaxUs = 0;
+unsigned long lastLoopUs = 0;
+unsigned long lastLoopReport = 0;
+
+// Buffers preasignados: ningún mensaje pasa por String ni por el heap
+char txBuffer[192];
+char localIp[16] = "0.0.0.0";  // IP en texto, se calcula una vez por conexión
+
+// Pines en el mismo orden que LED_IDS
+const int LED_PINS[] = {LED_PIN_1, LED_PIN_2, LED_PIN_3};
+
+void cacheLocalIp() {
+  IPAddress ip = WiFi.localIP();
+  snprintf(localIp, sizeof(localIp), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+// Envía los `len` bytes escritos en txBuffer (0 = no cabía en el buffer).
+// `logFmt` es el formato del registro de log, con la longitud como argumento.
+void sendBuffer(size_t len, const char* logFmt) {
+  if (len == 0) {
+    LOGE("Mensaje demasiado grande, descartado");
     return;
   }
+  LOGD(logFmt, len);
+  webSocket.sendTXT(txBuffer, len);
+}
 
-  if (doc["type"] == "toggle_device") {
-    const char* identifier = doc["identifier"];
-    bool state = doc["state"] == "on";
-    int pin = -1;
-    
-    Serial.print("Toggle recibido para: ");
-    Serial.print(identifier);
-    Serial.print(" estado: ");
-    Serial.println(state ? "on" : "off");
+// `seq` es la del comando que se confirma (nullptr en los anuncios)
+void sendStateUpdate(const char* identifier, bool state, const char* logFmt,
+                     const uint32_t* seq = nullptr, const protocol::Trace* trace = nullptr) {
+  sendBuffer(protocol::write_state_update(txBuffer, sizeof(txBuffer), identifier, state, localIp,
+                                          nullptr, seq, trace), logFmt);
+}
 
-    // Determinar qué LED controlar basado en el identificador
-    if (strcmp(identifier, "led_1") == 0) {
-      pin = LED_PIN_1;
-    } else if (strcmp(identifier, "led_2") == 0) {
-      pin = LED_PIN_2;
-    } else if (strcmp(identifier, "led_3") == 0) {
-      pin = LED_PIN_3;
+int findLed(std::string_view identifier) {
+  for (int i = 0; i < LED_ID_COUNT; i++) {
+    if (identifier == LED_IDS[i]) {
+      return i;
     }
+  }
+  return -1;
+}
 
-    if (pin != -1) {
-      digitalWrite(pin, state ? HIGH : LOW);
-      
-      // Enviar confirmación
-      StaticJsonDocument<200> response;
-      response["type"] = "state_update";
-      response["identifier"] = identifier;
-      response["state"] = state ? "on" : "off";
-      response["ip"] = WiFi.localIP().toString();
-      
-      String jsonString;
-      serializeJson(response, jsonString);
-      Serial.print("Enviando confirmación: ");
-      Serial.println(jsonString);
-      webSocket.sendTXT(jsonString);
+// Identificadores de traza más largos se ignoran
+const size_t TRACE_ID_MAX = 32;
+
+// Ventana de secuencias ya aplicadas, como la de ClienteESP: un comando que el
+// servidor reenvía tras perder la confirmación no se vuelve a aplicar. El bit
+// i de `seen` indica si se aplicó `highest - i`. Sobrevive a las reconexiones
+// del WebSocket pero no a un reinicio.
+const uint32_t SEQ_WINDOW_SIZE = 64;
+
+struct SeqWindow {
+  bool valid;
+  uint32_t highest;
+  uint64_t seen;
+};
+
+SeqWindow commandWindow = {false, 0, 0};
+
+// Devuelve true si la secuencia es nueva y la marca como aplicada
+bool seqWindowAccept(SeqWindow& w, uint32_t seq) {
+  if (!w.valid) {
+    w.valid = true;
+    w.highest = seq;
+    w.seen = 1;
+    return true;
+  }
+  if (static_cast<int32_t>(seq - w.highest) > 0) {
+    uint32_t shift = seq - w.highest;
+    w.seen = shift >= SEQ_WINDOW_SIZE ? 0 : w.seen << shift;
+    w.seen |= 1;
+    w.highest = seq;
+    return true;
+  }
+  uint32_t age = w.highest - seq;
+  if (age >= SEQ_WINDOW_SIZE) {
+    // Demasiado antigua para saberlo: se trata como repetida
+    return false;
+  }
+  if (w.seen & (1ULL << age)) {
+    return false;
+  }
+  w.seen |= 1ULL << age;
+  return true;
+}
+
+void handleWebSocketMessage(uint8_t * payload, size_t length) {
+  uint32_t receivedUs = micros();
+  // Los campos se leen directamente del payload, sin copiarlo ni parsearlo entero
+  std::string_view json(reinterpret_cast<const char*>(payload), length);
+
+  // El servidor numera los comandos y mantiene una ventana de pendientes: todo
+  // comando con "seq" se confirma con esa "seq", se haya aplicado o no
+  uint32_t seq;
+  const uint32_t* seqPtr = protocol::get_u32(json, "seq", seq) ? &seq : nullptr;
+  bool confirmed = false;
+
+  if (seqPtr && !seqWindowAccept(commandWindow, seq)) {
+    LOGI("Comando repetido (seq %lu), no se aplica", seq);
+    sendBuffer(protocol::write_ack(txBuffer, sizeof(txBuffer), seq, true), "Enviando ack de repetido (%lu bytes)");
+    return;
+  }
+
+  if (protocol::message_type(json) == protocol::MessageType::ToggleDevice) {
+    std::string_view identifier, stateStr;
+    bool state = protocol::get_string(json, "state", stateStr) && stateStr == "on";
+
+    // Determinar qué LED controlar basado en el identificador
+    int led = protocol::get_string(json, "identifier", identifier) ? findLed(identifier) : -1;
+    if (led != -1) {
+      LOGI("Toggle recibido: GPIO%lu estado %lu", LED_PINS[led], state);
+      digitalWrite(LED_PINS[led], state ? HIGH : LOW);
+      uint32_t appliedUs = micros();
+
+      // Enviar confirmación; con "trace", junto con los tiempos desde la recepción
+      protocol::Trace trace{};
+      if (protocol::get_string(json, "trace", trace.id) && !trace.id.empty() && trace.id.size() <= TRACE_ID_MAX) {
+        trace.apply_us = appliedUs - receivedUs;
+        trace.total_us = micros() - receivedUs;
+        sendStateUpdate(LED_IDS[led], state, "Enviando confirmación con traza (%lu bytes)", seqPtr, &trace);
+      } else {
+        sendStateUpdate(LED_IDS[led], state, "Enviando confirmación (%lu bytes)", seqPtr);
+      }
+      confirmed = true;
     }
   }
+
+  // set_many, reglas o salida desconocida: no se aplican en este firmware
+  if (seqPtr && !confirmed) {
+    sendBuffer(protocol::write_ack(txBuffer, sizeof(txBuffer), seq), "Enviando ack (%lu bytes)");
+  }
 }
 
 void sendDeviceInfo(const char* id) {
-  String ipAddress = WiFi.localIP().toString();
-  
   // Notificar conexión del dispositivo
-  StaticJsonDocument<200> status;
-  status["type"] = "device_connected";
-  status["identifier"] = id;
-  status["ip"] = ipAddress;
+  // Con "last_seq" el servidor sigue numerando por encima de lo ya aplicado
+  sendBuffer(protocol::write_device_connected(txBuffer, sizeof(txBuffer), id, localIp,
+                                              commandWindow.valid ? &commandWindow.highest : nullptr),
+             "Enviando mensaje de conexión (%lu bytes)");
   
-  String jsonString;
-  serializeJson(status, jsonString);
-  Serial.print("Enviando mensaje de conexión: ");
-  Serial.println(jsonString);
-  webSocket.sendTXT(jsonString.c_str());
-  
-  // Enviar estado inicial
-  StaticJsonDocument<200> state;
-  state["type"] = "state_update";
-  state["identifier"] = id;
-  state["state"] = "off";
-  state["ip"] = ipAddress;
-  
-  serializeJson(state, jsonString);
-  Serial.print("Enviando estado inicial: ");
-  Serial.println(jsonString);
-  webSocket.sendTXT(jsonString);
+  // Enviar estado inicial (antes se añadía al String del mensaje anterior)
+  sendStateUpdate(id, false, "Enviando estado inicial (%lu bytes)");
 }
 
 void webSocketEvent(WStype_t type, uint8_t * payload, size_t length) {
   switch(type) {
     case WStype_DISCONNECTED:
-      Serial.println("Desconectado del WebSocket");
+      LOGW("Desconectado del WebSocket");
       isConnected = false;
       break;
       
     case WStype_CONNECTED:
-      Serial.println("Conectado al WebSocket");
-      Serial.print("IP Local: ");
-      Serial.println(WiFi.localIP().toString());
+      LOGI("Conectado al WebSocket");
+      cacheLocalIp();
       isConnected = true;
-      
-      // Enviar información de los LEDs con un pequeño delay entre cada uno
-      delay(100);
-      sendDeviceInfo("led_1");
-      delay(100);
-      sendDeviceInfo("led_2");
-      delay(100);
-      sendDeviceInfo("led_3");
+
+      // La información de los LEDs se envía desde loop(), espaciada sin delay()
+      pendingAnnounce = 0;
+      lastAnnounce = millis();
       break;
       
     case WStype_TEXT:
-      Serial.print("Mensaje recibido: ");
-      Serial.println((char*)payload);
-      handleWebSocketMessage(payload);
+      LOGD("Mensaje recibido: %lu bytes", length);
+      handleWebSocketMessage(payload, length);
       break;
 
     case WStype_ERROR:
-      Serial.println("Error en WebSocket");
+      LOGE("Error en WebSocket");
       break;
 
     case WStype_PING:
-      Serial.println("Ping recibido");
+      LOGD("Ping recibido");
       break;
 
     case WStype_PONG:
-      Serial.println("Pong recibido");
+      LOGD("Pong recibido");
       break;
   }
 }
 
-void connectToWiFi() {
-  Serial.println("Conectando a WiFi...");
-  WiFi.begin(WIFI_SSID, WIFI_PASS);
-  
-  int attempts = 0;
-  while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
-    Serial.print(".");
-    attempts++;
+void onWiFiEvent(WiFiEvent_t event) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      wifiGotIp = true;
+      break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+      wifiLost = true;
+      break;
+    default:
+      break;
   }
-  
-  if (WiFi.status() == WL_CONNECTED) {
-    Serial.println("\nWiFi conectado!");
-    Serial.print("Dirección IP: ");
-    Serial.println(WiFi.localIP());
+}
+
+void setLinkState(LinkState state) {
+  linkState = state;
+  linkStateSince = millis();
+}
+
+bool loadWifiCache() {
+  size_t len = wifiPrefs.getBytes("cache", &wifiCache, sizeof(wifiCache));
+  return len == sizeof(wifiCache) && wifiCache.channel != 0 && wifiCache.ip != 0;
+}
+
+void saveWifiCache() {
+  WifiCache current = {};
+  memcpy(current.bssid, WiFi.BSSID(), sizeof(current.bssid));
+  current.channel = WiFi.channel();
+  current.ip = WiFi.localIP();
+  current.gateway = WiFi.gatewayIP();
+  current.subnet = WiFi.subnetMask();
+  current.dns = WiFi.dnsIP();
+
+  // Sólo se escribe si cambia: casi siempre se repiten AP e IP
+  if (memcmp(&current, &wifiCache, sizeof(current)) != 0) {
+    wifiCache = current;
+    wifiPrefs.putBytes("cache", &wifiCache, sizeof(wifiCache));
+  }
+}
+
+void startWiFi() {
+  wifiGotIp = false;
+  wifiLost = false;
+  if (!wifiMeasuring) {
+    wifiConnectStart = millis();
+    wifiMeasuring = true;
+  }
+
+  if (wifiFastPath) {
+    Serial.println("Conectando a WiFi (ruta rápida)...");
+    WiFi.config(IPAddress(wifiCache.ip), IPAddress(wifiCache.gateway),
+                IPAddress(wifiCache.subnet), IPAddress(wifiCache.dns));
+    WiFi.begin(WIFI_SSID, WIFI_PASS, wifiCache.channel, wifiCache.bssid);
   } else {
-    Serial.println("\nFallo al conectar WiFi");
-    ESP.restart();
+    Serial.println("Conectando a WiFi...");
+    // IP a cero: vuelve a DHCP
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    WiFi.begin(WIFI_SSID, WIFI_PASS);
   }
+  setLinkState(LINK_WIFI_CONNECTING);
+}
+
+// Un paso del supervisor de conexión; nunca espera
+void superviseConnection() {
+  unsigned long now = millis();
+
+  if (wifiLost && linkState != LINK_WIFI_DOWN && linkState != LINK_WIFI_CONNECTING) {
+    Serial.println("Conexión WiFi perdida. Reconectando...");
+    wifiLost = false;
+    webSocket.disconnect();
+    isConnected = false;
+    setLinkState(LINK_WIFI_DOWN);
+    linkStateSince = now - wifiRetryDelay;  // Reintentar de inmediato
+  }
+
+  switch (linkState) {
+    case LINK_WIFI_DOWN:
+      if (now - linkStateSince >= wifiRetryDelay) {
+        startWiFi();
+      }
+      break;
+
+    case LINK_WIFI_CONNECTING:
+      if (wifiGotIp) {
+        Serial.print("WiFi conectado! Dirección IP: ");
+        Serial.println(WiFi.localIP());
+        Serial.printf("Tiempo hasta IP: %lu ms (%s)\n", now - wifiConnectStart,
+                      wifiFastPath ? "ruta rápida" : "escaneo completo");
+        wifiMeasuring = false;
+        saveWifiCache();
+        wifiFastPath = true;  // La próxima reconexión usa esta misma red
+        wifiRetryDelay = WIFI_RETRY_MIN_MS;
+        wifiLost = false;  // Desconexiones de intentos anteriores ya no cuentan
+
+        // La librería gestiona sus propias reconexiones (setReconnectInterval):
+        // begin() solo se llama una vez
+        if (!wsStarted) {
+          webSocket.begin(WS_HOST, WS_PORT, "/");
+          wsStarted = true;
+          Serial.println("Conectando al servidor WebSocket...");
+        }
+        setLinkState(LINK_WS_CONNECTING);
+      } else if (wifiFastPath && now - linkStateSince >= WIFI_FAST_TIMEOUT_MS) {
+        // El AP guardado no responde: escaneo completo con DHCP, sin esperar
+        Serial.println("Ruta rápida fallida, escaneo completo");
+        WiFi.disconnect();
+        wifiFastPath = false;
+        wifiPrefs.remove("cache");
+        memset(&wifiCache, 0, sizeof(wifiCache));
+        startWiFi();
+      } else if (now - linkStateSince >= WIFI_CONNECT_TIMEOUT_MS) {
+        // En lugar de reiniciar el chip, reintentar con espera creciente
+        Serial.println("Fallo al conectar WiFi");
+        WiFi.disconnect();
+        setLinkState(LINK_WIFI_DOWN);
+        wifiRetryDelay = min(wifiRetryDelay * 2, WIFI_RETRY_MAX_MS);
+      }
+      break;
+
+    case LINK_WS_CONNECTING:
+      if (isConnected) {
+        setLinkState(LINK_ONLINE);
+      }
+      break;
+
+    case LINK_ONLINE:
+      if (!isConnected) {
+        setLinkState(LINK_WS_CONNECTING);
+      }
+      break;
+  }
+
+  if (isConnected && pendingAnnounce < LED_ID_COUNT && now - lastAnnounce >= ANNOUNCE_SPACING_MS) {
+    sendDeviceInfo(LED_IDS[pendingAnnounce++]);
+    lastAnnounce = now;
+  }
+}
+
+// Registra el periodo de la vuelta anterior de loop() e informa cada LOOP_REPORT_MS
+void trackLoopJitter() {
+  unsigned long nowUs = micros();
+  if (lastLoopUs != 0) {
+    unsigned long period = nowUs - lastLoopUs;
+    int bucket = min((int)(period / LOOP_BUCKET_US), LOOP_BUCKETS - 1);
+    loopHistogram[bucket]++;
+    loopSamples++;
+    if (period > loopMaxUs) {
+      loopMaxUs = period;
+    }
+  }
+  lastLoopUs = nowUs;
+
+  unsigned long now = millis();
+  if (now - lastLoopReport < LOOP_REPORT_MS || loopSamples == 0) {
+    return;
+  }
+  lastLoopReport = now;
+
+  // p99: límite superior del cubo donde se alcanza el 99% de las muestras
+  uint32_t target = loopSamples - loopSamples / 100;
+  uint32_t seen = 0;
+  int p99Bucket = 0;
+  for (; p99Bucket < LOOP_BUCKETS; p99Bucket++) {
+    seen += loopHistogram[p99Bucket];
+    if (seen >= target) {
+      break;
+    }
+  }
+
+  LOGI("Loop: %lu vueltas, max=%lu us, p99<=%lu us",
+       loopSamples, loopMaxUs, (p99Bucket + 1) * LOOP_BUCKET_US);
+
+  memset(loopHistogram, 0, sizeof(loopHistogram));
+  loopSamples = 0;
+  loopMaxUs = 0;
+  lastLoopUs = micros();  // No contar el propio informe como una vuelta lenta
 }
 
 void setup() {
   Serial.begin(115200);
+  dlogBegin();
   
   // Configurar pines de LEDs
   pinMode(LED_PIN_1, OUTPUT);
@@ -169,35 +446,21 @@ void setup() {
   digitalWrite(LED_PIN_2, LOW);
   digitalWrite(LED_PIN_3, LOW);
   
-  // Conectar WiFi
-  connectToWiFi();
-
-  // Configurar WebSocket con más opciones
-  webSocket.begin(WS_HOST, WS_PORT, "/");
+  // Configurar WebSocket; se inicia cuando el supervisor obtiene IP
   webSocket.onEvent(webSocketEvent);
   webSocket.setReconnectInterval(5000);
   webSocket.enableHeartbeat(15000, 3000, 2);
-  Serial.println("Conectando al servidor WebSocket...");
+
+  // Conectar WiFi, por la ruta rápida si hay una conexión buena guardada
+  wifiPrefs.begin("wifi", false);
+  wifiFastPath = loadWifiCache();
+  WiFi.onEvent(onWiFiEvent);
+  WiFi.setAutoReconnect(false);  // Los reintentos los decide el supervisor
+  startWiFi();
 }
 
 void loop() {
+  trackLoopJitter();
   webSocket.loop();
-
-  static unsigned long lastReconnectAttempt = 0;
-  const unsigned long reconnectInterval = 5000; // 5 segundos
-
-  // Si no está conectado y ha pasado el intervalo de reconexión
-  if (!isConnected && (millis() - lastReconnectAttempt > reconnectInterval)) {
-    lastReconnectAttempt = millis();
-    
-    if (WiFi.status() != WL_CONNECTED) {
-      Serial.println("Conexión WiFi perdida. Reconectando...");
-      connectToWiFi();
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println("Intentando reconectar WebSocket...");
-      webSocket.begin(WS_HOST, WS_PORT, "/");
-    }
-  }
-} 
\ No newline at end of file
+  superviseConnection();
+}
@@ -0,0 +1,299 @@
+// Prueba de resistencia del firmware Arduino (../main.cpp) en el host, con el
+// tiempo comprimido: por defecto 24 h simuladas de loop() cada milisegundo,
+// con comandos del servidor cada 20 ms, cortes del WebSocket, caídas del WiFi
+// y un cambio de AP. Comprueba que:
+//  - tras el arranque no hay ninguna reserva de memoria dinámica (el objetivo
+//    de enviar y parsear sin String ni heap) y el heap en uso no crece;
+//  - todo comando numerado recibe exactamente una respuesta con su "seq" y,
+//    si la traía, su traza;
+//  - un comando reenviado con la misma "seq" sólo recibe un ack de repetido;
+//  - todo lo enviado es un mensaje válido del protocolo y cada conexión
+//    anuncia las tres salidas;
+//  - la cola del log diferido nunca se desborda.
+//
+//   soak_firmware [horas simuladas]
+#include <malloc.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+#include "host_sim.h"
+#include "protocol_core.hpp"
+
+void setup();
+void loop();
+
+using namespace protocol;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            std::printf("%s:%d: falla: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                  \
+        }                                                                \
+    } while (0)
+
+// --- Reservas de memoria: se cuentan a partir de `counting` ---
+
+static bool counting = false;
+static size_t allocations = 0;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t n, size_t size);
+extern "C" void *__real_realloc(void *p, size_t size);
+
+extern "C" void *__wrap_malloc(size_t size) {
+    allocations += counting;
+    return __real_malloc(size);
+}
+
+extern "C" void *__wrap_calloc(size_t n, size_t size) {
+    allocations += counting;
+    return __real_calloc(n, size);
+}
+
+extern "C" void *__wrap_realloc(void *p, size_t size) {
+    allocations += counting;
+    return __real_realloc(p, size);
+}
+
+void *operator new(size_t size) {
+    allocations += counting;
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+// --- Servidor simulado ---
+
+static const uint64_t LOOP_US = 1000;
+static const uint64_t COMMAND_US = 20000;
+static const uint64_t LOG_DRAIN_US = 5000;
+static const uint64_t WS_DROP_US = 37ull * 60 * 1000000;       // Cierre del servidor cada 37 min
+static const uint64_t WIFI_DROP_US = 5ull * 3600 * 1000000;    // Caída del WiFi cada 5 h
+static const uint64_t WARMUP_US = 60ull * 1000000;
+
+struct Stats {
+    size_t commands = 0;
+    size_t numbered = 0;
+    size_t answered = 0;
+    size_t traced = 0;
+    size_t repeated = 0;
+    size_t lost_on_drop = 0;
+    size_t device_connected = 0;
+    size_t messages = 0;
+    size_t log_records = 0;
+};
+
+static Stats stats;
+static uint32_t next_seq = 1;
+static uint32_t pending_seq = 0;           // 0 = ninguno pendiente
+static char pending_trace[24];
+static bool pending_repeat = false;        // El pendiente es un reenvío
+static char last_numbered[160];            // Último comando numerado, para reenviarlo
+static int last_numbered_len = 0;
+static size_t pending_connects = 0;        // host::ws_connects al enviar el comando
+static size_t announced = 0;               // Salidas anunciadas en la conexión actual
+static size_t announced_connects = 0;
+
+static void on_send(const char *text, size_t len) {
+    std::string_view msg(text, len);
+    stats.messages++;
+    MessageType type = message_type(msg);
+    CHECK(type != MessageType::Unknown);
+
+    if (type == MessageType::DeviceConnected) {
+        stats.device_connected++;
+        if (announced_connects != host::ws_connects) {
+            announced_connects = host::ws_connects;
+            announced = 0;
+        }
+        announced++;
+        return;
+    }
+
+    uint32_t seq;
+    if (!get_u32(msg, "seq", seq)) {
+        return;
+    }
+    // Una sola respuesta por comando, con la "seq" del comando pendiente
+    CHECK(pending_seq != 0 && seq == pending_seq);
+    if (seq != pending_seq) {
+        return;
+    }
+    // Un reenvío no se aplica otra vez: ack de repetido, sin state_update
+    CHECK(!pending_repeat || (type == MessageType::Ack && msg.find(R"("duplicate":true)") != msg.npos));
+    if (pending_trace[0] && !pending_repeat) {
+        std::string_view trace;
+        CHECK(get_string(msg, "trace", trace) && trace == pending_trace);
+    }
+    pending_seq = 0;
+    stats.answered++;
+}
+
+// Siguiente comando: sobre todo toggles numerados, algunos con traza, y de vez
+// en cuando set_many, una salida desconocida, un comando sin "seq" o el
+// reenvío del último numerado (como tras perder su confirmación)
+static void send_command(uint64_t k) {
+    if (pending_seq) {
+        // Sólo puede quedar sin respuesta si la conexión se cortó entretanto
+        CHECK(pending_connects != host::ws_connects || !host::ws_connected());
+        stats.lost_on_drop++;
+        pending_seq = 0;
+    }
+
+    char buf[160];
+    int len;
+    uint32_t seq = next_seq++;
+    const char *state = (k / 3) % 2 ? "on" : "off";
+    pending_trace[0] = '\0';
+    pending_repeat = false;
+
+    switch (k % 20) {
+        case 0:
+            len = std::snprintf(buf, sizeof(buf), R"({"type":"set_many","mask":5,"states":%u,"seq":%u})",
+                                static_cast<unsigned>(k & 5), seq);
+            break;
+        case 1:
+            len = std::snprintf(buf, sizeof(buf),
+                                R"({"type":"toggle_device","identifier":"led_9","state":"on","seq":%u})", seq);
+            break;
+        case 2:
+            seq = 0;
+            next_seq--;
+            len = std::snprintf(buf, sizeof(buf), R"({"type":"toggle_device","identifier":"led_2","state":"%s"})",
+                                state);
+            break;
+        case 3:
+            if (last_numbered_len) {
+                next_seq--;
+                get_u32(std::string_view(last_numbered, last_numbered_len), "seq", seq);
+                stats.repeated++;
+                stats.commands++;
+                stats.numbered++;
+                pending_seq = seq;
+                pending_repeat = true;
+                pending_connects = host::ws_connects;
+                host::receive(last_numbered, static_cast<size_t>(last_numbered_len));
+                return;
+            }
+            [[fallthrough]];
+        default:
+            if (k % 4 == 0) {
+                std::snprintf(pending_trace, sizeof(pending_trace), "s%llu", static_cast<unsigned long long>(k));
+                stats.traced++;
+                len = std::snprintf(buf, sizeof(buf),
+                                    R"({"type":"toggle_device","identifier":"led_%u","state":"%s","seq":%u,"trace":"%s"})",
+                                    static_cast<unsigned>(k % 3 + 1), state, seq, pending_trace);
+            } else {
+                len = std::snprintf(buf, sizeof(buf),
+                                    R"({"type":"toggle_device","identifier":"led_%u","state":"%s","seq":%u})",
+                                    static_cast<unsigned>(k % 3 + 1), state, seq);
+            }
+            break;
+    }
+
+    stats.commands++;
+    if (seq) {
+        stats.numbered++;
+        pending_seq = seq;
+        pending_connects = host::ws_connects;
+        std::memcpy(last_numbered, buf, static_cast<size_t>(len));
+        last_numbered_len = len;
+    }
+    host::receive(buf, static_cast<size_t>(len));
+}
+
+int main(int argc, char **argv) {
+    double hours = argc > 1 ? std::atof(argv[1]) : 24;
+    const uint64_t end_us = static_cast<uint64_t>(hours * 3600e6);
+    host::on_ws_send = on_send;
+
+    setup();
+
+    uint64_t next_command = 0, next_drain = 0;
+    uint64_t next_ws_drop = WS_DROP_US, next_wifi_drop = WIFI_DROP_US;
+    uint64_t ap_change = end_us / 2;
+    uint64_t commands = 0, iterations = 0;
+    size_t heap_start = 0;
+    auto wall_start = std::chrono::steady_clock::now();
+
+    for (; host::now_us < end_us; host::now_us += LOOP_US, iterations++) {
+        if (!counting && host::now_us >= WARMUP_US) {
+            counting = true;
+            heap_start = mallinfo2().uordblks;
+        }
+
+        host::poll_wifi();
+        loop();
+
+        if (host::now_us >= next_drain) {
+            stats.log_records += host::drain_queues();
+            next_drain += LOG_DRAIN_US;
+        }
+
+        bool ready = host::ws_connected() && announced_connects == host::ws_connects && announced == 3;
+        if (ready && host::now_us >= next_command) {
+            send_command(commands++);
+            next_command = host::now_us + COMMAND_US;
+        }
+
+        if (host::now_us >= next_ws_drop) {
+            host::drop_ws();
+            next_ws_drop += WS_DROP_US;
+        }
+        if (host::now_us >= next_wifi_drop) {
+            host::drop_wifi();
+            next_wifi_drop += WIFI_DROP_US;
+        }
+        if (ap_change && host::now_us >= ap_change) {
+            host::replace_ap();
+            ap_change = 0;
+        }
+    }
+    counting = false;
+    size_t heap_end = mallinfo2().uordblks;
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+    std::printf("%.1f h simuladas en %.1f s (%llu vueltas de loop(), %.0f ns/vuelta)\n", hours, wall_s,
+                static_cast<unsigned long long>(iterations), wall_s * 1e9 / iterations);
+    std::printf("Conexiones WebSocket: %zu; WiFi: %zu por ruta rápida, %zu con escaneo\n", host::ws_connects,
+                host::wifi_fast_connects, host::wifi_scan_connects);
+    std::printf("Comandos: %zu (%zu numerados, %zu con traza, %zu reenvíos), respondidos %zu, perdidos en cortes %zu\n",
+                stats.commands, stats.numbered, stats.traced, stats.repeated, stats.answered, stats.lost_on_drop);
+    std::printf("Mensajes enviados: %zu; registros de log: %zu, descartados %zu\n", stats.messages,
+                stats.log_records, host::queue_overflows);
+    std::printf("Reservas tras el arranque: %zu; heap en uso: %zu -> %zu bytes\n", allocations, heap_start,
+                heap_end);
+
+    CHECK(allocations == 0);
+    CHECK(heap_end <= heap_start);
+    CHECK(stats.commands > 0);
+    CHECK(stats.answered + stats.lost_on_drop == stats.numbered);
+    CHECK(stats.lost_on_drop <= host::ws_connects);
+    CHECK(stats.device_connected == 3 * host::ws_connects);
+    if (hours >= 12) {
+        // Cortes, caídas del WiFi (ruta rápida) y cambio de AP (escaneo de nuevo)
+        CHECK(host::ws_connects > 1 && host::wifi_scan_connects >= 2 && host::wifi_fast_connects >= 1);
+    }
+    CHECK(host::queue_overflows == 0);
+
+    if (failures) {
+        std::printf("%d comprobaciones fallidas\n", failures);
+        return 1;
+    }
+    std::printf("OK\n");
+    return 0;
+}
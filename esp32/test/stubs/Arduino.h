@@ -0,0 +1,75 @@
+#pragma once
+
+// Núcleo de Arduino mínimo para compilar ../../main.cpp en el host (ver
+// ../soak_firmware.cpp). Sólo lo que usa el firmware. El tiempo es simulado:
+// lo avanza la prueba y millis()/micros() lo leen.
+//
+// En el host unsigned long es de 64 bits, así que el desbordamiento de
+// micros() cada ~71 min del ESP32 no se reproduce.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+using std::max;
+using std::min;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+
+#include "host_sim.h"
+
+inline unsigned long millis() { return static_cast<unsigned long>(host::now_us / 1000); }
+inline unsigned long micros() { return static_cast<unsigned long>(host::now_us); }
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class IPAddress {
+public:
+    IPAddress() = default;
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes_{a, b, c, d} {}
+    explicit IPAddress(uint32_t value) { std::memcpy(bytes_, &value, sizeof(bytes_)); }
+    operator uint32_t() const {
+        uint32_t value;
+        std::memcpy(&value, bytes_, sizeof(value));
+        return value;
+    }
+    uint8_t operator[](int i) const { return bytes_[i]; }
+
+private:
+    uint8_t bytes_[4] = {0, 0, 0, 0};
+};
+
+class HardwareSerial {
+public:
+    void begin(unsigned long) {}
+    template <typename T> size_t print(const T &) { return 0; }
+    template <typename T> size_t println(const T &) { return 0; }
+    size_t println() { return 0; }
+    int printf(const char *fmt, ...);
+    int availableForWrite() { return 128; }
+    size_t write(const uint8_t *, size_t len) { return len; }
+};
+
+extern HardwareSerial Serial;
+
+// FreeRTOS: colas de copia sin bloqueo; las tareas no se ejecutan (la prueba
+// vacía las colas con host::drain_queues(), como haría la tarea de log)
+typedef void *QueueHandle_t;
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdMS_TO_TICKS(ms) (ms)
+
+QueueHandle_t xQueueCreate(uint32_t length, uint32_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stack, void *arg,
+                                   int priority, void *handle, int core);
+inline void vTaskDelay(TickType_t) {}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Arduino.h"
+
+// NVS simulada en memoria, sin reservas dinámicas
+class Preferences {
+public:
+    bool begin(const char *name, bool read_only = false);
+    size_t getBytes(const char *key, void *buf, size_t len);
+    size_t putBytes(const char *key, const void *value, size_t len);
+    bool remove(const char *key);
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Arduino.h"
+
+typedef enum {
+    WStype_ERROR,
+    WStype_DISCONNECTED,
+    WStype_CONNECTED,
+    WStype_TEXT,
+    WStype_BIN,
+    WStype_FRAGMENT_TEXT_START,
+    WStype_FRAGMENT_BIN_START,
+    WStype_FRAGMENT,
+    WStype_FRAGMENT_FIN,
+    WStype_PING,
+    WStype_PONG,
+} WStype_t;
+
+// Como la librería real, los eventos se entregan desde loop()
+class WebSocketsClient {
+public:
+    typedef void (*WebSocketClientEvent)(WStype_t type, uint8_t *payload, size_t length);
+
+    void begin(const char *host, uint16_t port, const char *url = "/");
+    void onEvent(WebSocketClientEvent cb);
+    void setReconnectInterval(unsigned long ms);
+    void enableHeartbeat(uint32_t ping_ms, uint32_t pong_timeout_ms, uint8_t disconnect_count) {}
+    void loop();
+    void disconnect();
+    bool sendTXT(const char *payload, size_t length);
+};
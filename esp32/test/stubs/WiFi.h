@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Arduino.h"
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP,
+} WiFiEvent_t;
+
+typedef void (*WiFiEventCb)(WiFiEvent_t event);
+
+// Asociación simulada: con BSSID y canal (ruta rápida) tarda menos que con
+// escaneo y DHCP
+class WiFiClass {
+public:
+    int begin(const char *ssid, const char *pass, int32_t channel = 0, const uint8_t *bssid = nullptr,
+              bool connect = true);
+    bool config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress());
+    bool disconnect(bool wifi_off = false);
+    bool setAutoReconnect(bool) { return true; }
+    void onEvent(WiFiEventCb cb);
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    uint8_t *BSSID();
+    int32_t channel();
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,321 @@
+// Implementación del entorno simulado de los stubs de Arduino
+#include <cstdarg>
+#include "Arduino.h"
+#include "Preferences.h"
+#include "WebSocketsClient.h"
+#include "WiFi.h"
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+namespace host {
+
+uint64_t now_us = 0;
+void (*on_ws_send)(const char *text, size_t len) = nullptr;
+size_t queue_overflows = 0;
+size_t ws_connects = 0;
+size_t wifi_fast_connects = 0;
+size_t wifi_scan_connects = 0;
+
+namespace {
+
+const uint64_t FAST_ASSOC_US = 300000;     // Ruta rápida: BSSID, canal e IP fija
+const uint64_t SCAN_ASSOC_US = 2500000;    // Escaneo completo y DHCP
+uint8_t AP_BSSID[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+const int32_t AP_CHANNEL = 6;
+const IPAddress DHCP_IP(192, 168, 1, 60);
+
+// WiFi
+WiFiEventCb wifi_cb = nullptr;
+bool wifi_associating = false;
+bool wifi_up = false;
+bool wifi_fast = false;
+uint64_t wifi_ready_at = 0;
+uint32_t static_ip = 0;
+uint8_t bssid[6];
+
+// WebSocket
+WebSocketsClient::WebSocketClientEvent ws_cb = nullptr;
+bool ws_started = false;
+bool ws_up = false;
+bool ws_closed = false;            // Cierre pendiente de notificar
+uint64_t ws_retry_us = 5000000;
+uint64_t ws_next_attempt = 0;
+char rx_buf[256];
+size_t rx_len = 0;
+bool rx_pending = false;
+
+// Colas de FreeRTOS con almacenamiento fijo
+struct Queue {
+    uint8_t storage[64 * 32];
+    uint32_t item_size;
+    uint32_t length;
+    uint32_t head;
+    uint32_t count;
+};
+Queue queues[4];
+size_t queue_count = 0;
+
+// Preferences: unas pocas claves de tamaño acotado
+struct Entry {
+    char key[16];
+    uint8_t value[64];
+    size_t len;
+    bool used;
+};
+Entry prefs[8];
+
+Entry *find_pref(const char *key) {
+    for (Entry &e : prefs) {
+        if (e.used && std::strcmp(e.key, key) == 0) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+void poll_wifi() {
+    if (wifi_associating && now_us >= wifi_ready_at) {
+        wifi_associating = false;
+        wifi_up = true;
+        if (wifi_fast) {
+            wifi_fast_connects++;
+        } else {
+            wifi_scan_connects++;
+        }
+        if (wifi_cb) {
+            wifi_cb(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+        }
+    }
+}
+
+void drop_wifi() {
+    wifi_associating = false;
+    wifi_up = false;
+    if (ws_up) {
+        ws_up = false;
+        ws_closed = true;
+        ws_next_attempt = now_us + ws_retry_us;
+    }
+    if (wifi_cb) {
+        wifi_cb(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+}
+
+void drop_ws() {
+    if (ws_up) {
+        ws_up = false;
+        ws_closed = true;
+        ws_next_attempt = now_us + ws_retry_us;
+    }
+}
+
+void replace_ap() {
+    AP_BSSID[5]++;
+    drop_wifi();
+}
+
+bool ws_connected() { return ws_up; }
+
+void receive(const char *text, size_t len) {
+    if (len < sizeof(rx_buf)) {
+        std::memcpy(rx_buf, text, len);
+        rx_buf[len] = '\0';
+        rx_len = len;
+        rx_pending = true;
+    }
+}
+
+size_t drain_queues() {
+    size_t drained = 0;
+    for (size_t i = 0; i < queue_count; i++) {
+        drained += queues[i].count;
+        queues[i].head = (queues[i].head + queues[i].count) % queues[i].length;
+        queues[i].count = 0;
+    }
+    return drained;
+}
+
+}  // namespace host
+
+using namespace host;
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+
+int HardwareSerial::printf(const char *fmt, ...) {
+    char line[128];
+    va_list args;
+    va_start(args, fmt);
+    int len = std::vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    return len;
+}
+
+QueueHandle_t xQueueCreate(uint32_t length, uint32_t item_size) {
+    if (queue_count == sizeof(queues) / sizeof(queues[0]) || length * item_size > sizeof(queues[0].storage)) {
+        return nullptr;
+    }
+    Queue *q = &queues[queue_count++];
+    q->item_size = item_size;
+    q->length = length;
+    return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t) {
+    Queue *q = static_cast<Queue *>(queue);
+    if (q->count == q->length) {
+        queue_overflows++;
+        return pdFALSE;
+    }
+    std::memcpy(q->storage + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+    q->count++;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t) {
+    Queue *q = static_cast<Queue *>(queue);
+    if (q->count == 0) {
+        return pdFALSE;
+    }
+    std::memcpy(item, q->storage + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    return pdTRUE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*)(void *), const char *, uint32_t, void *, int, void *, int) {
+    return pdTRUE;
+}
+
+// --- WiFi ---
+
+int WiFiClass::begin(const char *, const char *, int32_t channel, const uint8_t *ap_bssid, bool) {
+    // La ruta rápida sólo funciona si el AP guardado sigue siendo el mismo
+    wifi_fast = channel == AP_CHANNEL && ap_bssid && std::memcmp(ap_bssid, AP_BSSID, sizeof(AP_BSSID)) == 0;
+    wifi_associating = true;
+    wifi_up = false;
+    wifi_ready_at = now_us + (wifi_fast ? FAST_ASSOC_US : SCAN_ASSOC_US);
+    return 0;
+}
+
+bool WiFiClass::config(IPAddress ip, IPAddress, IPAddress, IPAddress) {
+    static_ip = ip;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool) {
+    wifi_associating = false;
+    wifi_up = false;
+    return true;
+}
+
+void WiFiClass::onEvent(WiFiEventCb cb) { wifi_cb = cb; }
+
+IPAddress WiFiClass::localIP() {
+    if (!wifi_up) {
+        return IPAddress();
+    }
+    return static_ip ? IPAddress(static_ip) : DHCP_IP;
+}
+
+IPAddress WiFiClass::gatewayIP() { return IPAddress(192, 168, 1, 1); }
+IPAddress WiFiClass::subnetMask() { return IPAddress(255, 255, 255, 0); }
+IPAddress WiFiClass::dnsIP(uint8_t) { return IPAddress(192, 168, 1, 1); }
+
+uint8_t *WiFiClass::BSSID() {
+    std::memcpy(bssid, AP_BSSID, sizeof(bssid));
+    return bssid;
+}
+
+int32_t WiFiClass::channel() { return AP_CHANNEL; }
+
+// --- Preferences ---
+
+bool Preferences::begin(const char *, bool) { return true; }
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t len) {
+    Entry *e = find_pref(key);
+    if (!e || e->len > len) {
+        return 0;
+    }
+    std::memcpy(buf, e->value, e->len);
+    return e->len;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+    Entry *e = find_pref(key);
+    for (size_t i = 0; !e && i < sizeof(prefs) / sizeof(prefs[0]); i++) {
+        if (!prefs[i].used) {
+            e = &prefs[i];
+            std::snprintf(e->key, sizeof(e->key), "%s", key);
+            e->used = true;
+        }
+    }
+    if (!e || len > sizeof(e->value)) {
+        return 0;
+    }
+    std::memcpy(e->value, value, len);
+    e->len = len;
+    return len;
+}
+
+bool Preferences::remove(const char *key) {
+    Entry *e = find_pref(key);
+    if (e) {
+        e->used = false;
+    }
+    return e != nullptr;
+}
+
+// --- WebSocket ---
+
+void WebSocketsClient::begin(const char *, uint16_t, const char *) {
+    ws_started = true;
+    ws_next_attempt = now_us;
+}
+
+void WebSocketsClient::onEvent(WebSocketClientEvent cb) { ws_cb = cb; }
+
+void WebSocketsClient::setReconnectInterval(unsigned long ms) { ws_retry_us = static_cast<uint64_t>(ms) * 1000; }
+
+void WebSocketsClient::loop() {
+    if (ws_closed) {
+        ws_closed = false;
+        rx_pending = false;
+        if (ws_cb) {
+            ws_cb(WStype_DISCONNECTED, nullptr, 0);
+        }
+        return;
+    }
+    if (!ws_up) {
+        if (ws_started && wifi_up && now_us >= ws_next_attempt) {
+            ws_up = true;
+            ws_connects++;
+            if (ws_cb) {
+                ws_cb(WStype_CONNECTED, reinterpret_cast<uint8_t *>(const_cast<char *>("/")), 1);
+            }
+        }
+        return;
+    }
+    if (rx_pending) {
+        rx_pending = false;
+        if (ws_cb) {
+            ws_cb(WStype_TEXT, reinterpret_cast<uint8_t *>(rx_buf), rx_len);
+        }
+    }
+}
+
+void WebSocketsClient::disconnect() { drop_ws(); }
+
+bool WebSocketsClient::sendTXT(const char *payload, size_t length) {
+    if (!ws_up) {
+        return false;
+    }
+    if (on_ws_send) {
+        on_ws_send(payload, length);
+    }
+    return true;
+}
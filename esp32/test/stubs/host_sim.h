@@ -0,0 +1,36 @@
+#pragma once
+
+// Control del entorno simulado desde la prueba: tiempo, red y servidor
+
+#include <cstddef>
+#include <cstdint>
+
+namespace host {
+
+extern uint64_t now_us;
+
+// Texto enviado por el firmware al servidor
+extern void (*on_ws_send)(const char *text, size_t len);
+
+// Procesa los eventos pendientes del WiFi (los entrega la tarea del driver)
+void poll_wifi();
+// El AP desaparece: desconexión y pérdida de IP
+void drop_wifi();
+// Se cambia el AP por otro con distinto BSSID: la ruta rápida guardada falla
+void replace_ap();
+// El servidor cierra el WebSocket; la librería reintenta tras su intervalo
+void drop_ws();
+bool ws_connected();
+// Mensaje de texto del servidor, entregado en el siguiente webSocket.loop()
+void receive(const char *text, size_t len);
+
+// Vacía las colas de FreeRTOS; devuelve los elementos sacados
+size_t drain_queues();
+// Envíos a una cola llena (registros de log perdidos)
+extern size_t queue_overflows;
+
+extern size_t ws_connects;
+extern size_t wifi_fast_connects;
+extern size_t wifi_scan_connects;
+
+}  // namespace host
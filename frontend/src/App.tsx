@@ -8,6 +8,7 @@ import { GaugeWidget } from './components/widgets/GaugeWidget';
 import { IndicatorWidget } from './components/widgets/IndicatorWidget';
 import { CameraWidget } from './components/widgets/CameraWidget';
 import { wsService } from './services/websocket.service';
+import { traceService } from './services/trace.service';
 
 interface NetworkIP {
   name: string;
@@ -64,8 +65,13 @@ function App() {
       }
       else if (data.type === 'state_update') {
         console.log('Actualización de estado:', data);
-        setDevices(prevDevices => 
+        traceService.received(data.trace);
+        setDevices(prevDevices =>
           prevDevices.map(device => {
+            // Confirmación combinada de set_many: { states: { led_1: 'on', ... } }
+            if (data.states && device.identifier && data.states[device.identifier]) {
+              return { ...device, data: { state: data.states[device.identifier] } };
+            }
             if (device.identifier === data.identifier) {
               console.log('Actualizando dispositivo:', device.identifier);
               return { ...device, data: { state: data.state } };
@@ -99,6 +105,11 @@ function App() {
       });
   }, []);
 
+  // Tras pintar un estado nuevo, cerrar las trazas de los comandos confirmados
+  useEffect(() => {
+    traceService.rendered();
+  }, [devices]);
+
   const handleConfigureDevice = (device: Device) => {
     setSelectedDevice(device);
     setIsConfigModalOpen(true);
@@ -121,8 +132,10 @@ function App() {
           const newState = device.data?.state === 'on' ? 'off' : 'on';
           wsService.sendMessage({
             type: 'toggle_device',
+            ip: device.ip,
             identifier: device.identifier,
-            state: newState
+            state: newState,
+            trace: traceService.start()
           });
         }}
       >
@@ -0,0 +1,58 @@
+import { wsService } from './websocket.service';
+
+interface PendingTrace {
+  sentAt: number;
+  receivedAt?: number;
+}
+
+// Trazas sin confirmar que se guardan como máximo (clics sin respuesta)
+const MAX_PENDING = 100;
+
+/**
+ * Trazas de los toggle_device enviados desde este panel. Al pintar la
+ * confirmación se informa al servidor del tiempo total (clic -> pintado) y
+ * del de render (recepción -> pintado), ambos con el reloj del navegador.
+ */
+class TraceService {
+  private pending: Map<string, PendingTrace> = new Map();
+
+  /** Nuevo identificador de traza para un comando que se va a enviar */
+  public start(): string {
+    const id = `${Date.now().toString(36)}${Math.random().toString(36).slice(2, 8)}`;
+    if (this.pending.size >= MAX_PENDING) {
+      this.pending.delete(this.pending.keys().next().value as string);
+    }
+    this.pending.set(id, { sentAt: performance.now() });
+    return id;
+  }
+
+  /** Confirmación recibida; se informa tras el siguiente pintado (rendered) */
+  public received(id: unknown) {
+    const trace = typeof id === 'string' ? this.pending.get(id) : undefined;
+    if (trace && trace.receivedAt === undefined) {
+      trace.receivedAt = performance.now();
+    }
+  }
+
+  /** Llamar después de aplicar el estado: mide en el siguiente frame */
+  public rendered() {
+    const done = [...this.pending].filter(([, trace]) => trace.receivedAt !== undefined);
+    if (done.length === 0) {
+      return;
+    }
+    done.forEach(([id]) => this.pending.delete(id));
+    requestAnimationFrame(() => {
+      const now = performance.now();
+      done.forEach(([id, trace]) => {
+        wsService.sendMessage({
+          type: 'trace_report',
+          trace: id,
+          total_ms: now - trace.sentAt,
+          render_ms: now - trace.receivedAt!,
+        });
+      });
+    });
+  }
+}
+
+export const traceService = new TraceService();
@@ -2,6 +2,8 @@ export class WebSocketService {
   private ws: WebSocket | null = null;
   private messageHandlers: ((data: any) => void)[] = [];
   private serverUrl: string = '';
+  // Temas de los que el servidor nos envía actualizaciones ('*' = todos)
+  private topics: string[] = ['*'];
 
   constructor() {
     this.init();
@@ -26,6 +28,10 @@ export class WebSocketService {
     
     this.ws = new WebSocket(this.serverUrl);
 
+    this.ws.onopen = () => {
+      this.sendMessage({ type: 'subscribe', topics: this.topics });
+    };
+
     this.ws.onmessage = async (event) => {
       try {
         let data;
@@ -57,6 +63,12 @@ export class WebSocketService {
     this.messageHandlers.push(handler);
   }
 
+  /** Sustituye los temas suscritos; se vuelven a enviar en cada reconexión */
+  public subscribe(topics: string[]) {
+    this.topics = topics;
+    this.sendMessage({ type: 'subscribe', topics });
+  }
+
   public sendMessage(message: any) {
     if (this.ws?.readyState === WebSocket.OPEN) {
       this.ws.send(JSON.stringify(message));
@@ -0,0 +1,91 @@
+#include "protocol_c.h"
+#include "protocol_core.hpp"
+#include <new>
+
+using protocol::MessageType;
+
+static_assert(static_cast<int>(MessageType::DeviceConnected) == PROTO_MSG_DEVICE_CONNECTED);
+static_assert(static_cast<int>(MessageType::ToggleDevice) == PROTO_MSG_TOGGLE_DEVICE);
+static_assert(static_cast<int>(MessageType::Health) == PROTO_MSG_HEALTH);
+
+static_assert(sizeof(proto_writer_t) >= sizeof(protocol::Writer));
+static_assert(alignof(proto_writer_t) >= alignof(protocol::Writer));
+
+static protocol::Writer &writer(proto_writer_t *w) {
+    return *std::launder(reinterpret_cast<protocol::Writer *>(w));
+}
+
+extern "C" proto_msg_type_t proto_message_type(const char *json, size_t len) {
+    return static_cast<proto_msg_type_t>(protocol::message_type({json, len}));
+}
+
+extern "C" bool proto_get_string(const char *json, size_t len, const char *key, const char **value,
+                                 size_t *value_len) {
+    std::string_view out;
+    if (!protocol::get_string({json, len}, key, out)) {
+        return false;
+    }
+    *value = out.data();
+    *value_len = out.size();
+    return true;
+}
+
+extern "C" bool proto_get_u32(const char *json, size_t len, const char *key, uint32_t *value) {
+    return protocol::get_u32({json, len}, key, *value);
+}
+
+extern "C" size_t proto_write_device_connected(char *buf, size_t cap, const char *identifier, const char *ip,
+                                               const uint32_t *last_seq) {
+    return protocol::write_device_connected(buf, cap, identifier, ip, last_seq);
+}
+
+extern "C" size_t proto_write_state_update(char *buf, size_t cap, const char *identifier, bool on, const char *ip,
+                                           const uint32_t *version, const uint32_t *seq,
+                                           const proto_trace_t *trace) {
+    if (trace) {
+        protocol::Trace t{{trace->id, trace->id_len}, trace->apply_us, trace->total_us};
+        return protocol::write_state_update(buf, cap, identifier, on, ip, version, seq, &t);
+    }
+    return protocol::write_state_update(buf, cap, identifier, on, ip, version, seq);
+}
+
+extern "C" size_t proto_write_ack(char *buf, size_t cap, uint32_t seq, bool duplicate) {
+    return protocol::write_ack(buf, cap, seq, duplicate);
+}
+
+extern "C" void proto_writer_begin(proto_writer_t *w, char *buf, size_t cap, proto_msg_type_t type) {
+    new (w) protocol::Writer(buf, cap);
+    writer(w).begin(static_cast<MessageType>(type));
+}
+
+extern "C" void proto_writer_str(proto_writer_t *w, const char *key, const char *value) {
+    writer(w).field(key, value);
+}
+
+extern "C" void proto_writer_u32(proto_writer_t *w, const char *key, uint32_t value) {
+    writer(w).field(key, value);
+}
+
+extern "C" void proto_writer_i32(proto_writer_t *w, const char *key, int32_t value) {
+    writer(w).field(key, value);
+}
+
+extern "C" void proto_writer_bool(proto_writer_t *w, const char *key, bool value) {
+    writer(w).flag(key, value);
+}
+
+extern "C" void proto_writer_state(proto_writer_t *w, const char *key, bool on) {
+    writer(w).state(key, on);
+}
+
+extern "C" void proto_writer_open(proto_writer_t *w, const char *key) {
+    writer(w).open(key);
+}
+
+extern "C" void proto_writer_close(proto_writer_t *w) {
+    writer(w).close();
+}
+
+extern "C" size_t proto_writer_finish(proto_writer_t *w) {
+    return writer(w).finish();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Interfaz C del núcleo del protocolo (protocol_core.hpp) para el firmware
+// ESP-IDF, escrito en C. Mismo análisis y serialización que el firmware Arduino.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Mismo orden que protocol::MessageType
+typedef enum {
+    PROTO_MSG_UNKNOWN = 0,
+    PROTO_MSG_DEVICE_CONNECTED,
+    PROTO_MSG_STATE_UPDATE,
+    PROTO_MSG_STATE_DELTA,
+    PROTO_MSG_TOGGLE_DEVICE,
+    PROTO_MSG_SET_MANY,
+    PROTO_MSG_STATE_ACK,
+    PROTO_MSG_RESYNC_REQUEST,
+    PROTO_MSG_RULES,
+    PROTO_MSG_RULES_LOADED,
+    PROTO_MSG_CLOCK,
+    PROTO_MSG_ACK,
+    PROTO_MSG_HEALTH,
+} proto_msg_type_t;
+
+// Tipo del mensaje según su campo "type"
+proto_msg_type_t proto_message_type(const char *json, size_t len);
+
+// Campo de texto de primer nivel. `value` apunta dentro de `json`, sin '\0'
+// final y sin decodificar escapes.
+bool proto_get_string(const char *json, size_t len, const char *key, const char **value, size_t *value_len);
+
+// Campo numérico entero sin signo de primer nivel
+bool proto_get_u32(const char *json, size_t len, const char *key, uint32_t *value);
+
+// Traza de un comando (ver protocol::Trace). `id` apunta al campo "trace"
+// del comando recibido y no termina en '\0'.
+typedef struct {
+    const char *id;
+    size_t id_len;
+    uint32_t apply_us;
+    uint32_t total_us;
+} proto_trace_t;
+
+// Escriben el mensaje en `buf` terminado en '\0' y devuelven su longitud, o 0
+// si no cabe. Los punteros opcionales a NULL omiten el campo.
+size_t proto_write_device_connected(char *buf, size_t cap, const char *identifier, const char *ip,
+                                    const uint32_t *last_seq);
+size_t proto_write_state_update(char *buf, size_t cap, const char *identifier, bool on, const char *ip,
+                                const uint32_t *version, const uint32_t *seq, const proto_trace_t *trace);
+size_t proto_write_ack(char *buf, size_t cap, uint32_t seq, bool duplicate);
+
+// Escritor genérico (protocol::Writer) para mensajes que no tienen función
+// propia. Misma regla: si no cabe, proto_writer_finish() devuelve 0.
+typedef struct {
+    void *opaque_[2];
+    size_t size_[2];
+} proto_writer_t;
+
+void proto_writer_begin(proto_writer_t *w, char *buf, size_t cap, proto_msg_type_t type);
+void proto_writer_str(proto_writer_t *w, const char *key, const char *value);
+void proto_writer_u32(proto_writer_t *w, const char *key, uint32_t value);
+void proto_writer_i32(proto_writer_t *w, const char *key, int32_t value);
+void proto_writer_bool(proto_writer_t *w, const char *key, bool value);
+// "on"/"off"
+void proto_writer_state(proto_writer_t *w, const char *key, bool on);
+// Objeto anidado en `key` hasta proto_writer_close()
+void proto_writer_open(proto_writer_t *w, const char *key);
+void proto_writer_close(proto_writer_t *w);
+size_t proto_writer_finish(proto_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
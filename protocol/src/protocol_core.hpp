@@ -0,0 +1,493 @@
+#pragma once
+
+// Núcleo del protocolo dispositivo <-> servidor, común a los dos firmwares
+// (ClienteESP con ESP-IDF y esp32 con Arduino). Sólo cabecera, C++17, sin
+// memoria dinámica:
+//  - el tipo de mensaje se resuelve con una tabla hash construida al compilar;
+//  - el prefijo fijo de cada mensaje ({"type":"...") es una constante;
+//  - la lectura busca campos de primer nivel directamente en el texto, sin
+//    construir un árbol, y la escritura va a un buffer del llamante.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace protocol {
+
+enum class MessageType : uint8_t {
+    Unknown = 0,
+    DeviceConnected,
+    StateUpdate,
+    StateDelta,
+    ToggleDevice,
+    SetMany,
+    StateAck,
+    ResyncRequest,
+    Rules,
+    RulesLoaded,
+    Clock,
+    Ack,
+    Health,
+};
+
+// FNV-1a de 32 bits
+constexpr uint32_t hash(std::string_view s) {
+    uint32_t h = 2166136261u;
+    for (char c : s) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+struct TypeName {
+    std::string_view name;
+    MessageType type;
+};
+
+inline constexpr std::array<TypeName, 12> kTypeNames = {{
+    {"device_connected", MessageType::DeviceConnected},
+    {"state_update", MessageType::StateUpdate},
+    {"state_delta", MessageType::StateDelta},
+    {"toggle_device", MessageType::ToggleDevice},
+    {"set_many", MessageType::SetMany},
+    {"state_ack", MessageType::StateAck},
+    {"resync_request", MessageType::ResyncRequest},
+    {"rules", MessageType::Rules},
+    {"rules_loaded", MessageType::RulesLoaded},
+    {"clock", MessageType::Clock},
+    {"ack", MessageType::Ack},
+    {"health", MessageType::Health},
+}};
+
+namespace detail {
+
+inline constexpr size_t kSlots = 32;  // Potencia de 2, menos de la mitad ocupada
+inline constexpr uint8_t kEmpty = 0xFF;
+
+// Direccionamiento abierto con sondeo lineal; índice en kTypeNames por hueco
+constexpr std::array<uint8_t, kSlots> build_type_table() {
+    std::array<uint8_t, kSlots> slots{};
+    for (auto &s : slots) {
+        s = kEmpty;
+    }
+    for (size_t i = 0; i < kTypeNames.size(); i++) {
+        size_t idx = hash(kTypeNames[i].name) & (kSlots - 1);
+        while (slots[idx] != kEmpty) {
+            idx = (idx + 1) & (kSlots - 1);
+        }
+        slots[idx] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+inline constexpr auto kTypeTable = build_type_table();
+
+}  // namespace detail
+
+constexpr MessageType classify(std::string_view name) {
+    const uint32_t h = hash(name);
+    for (size_t idx = h & (detail::kSlots - 1); detail::kTypeTable[idx] != detail::kEmpty;
+         idx = (idx + 1) & (detail::kSlots - 1)) {
+        const TypeName &entry = kTypeNames[detail::kTypeTable[idx]];
+        if (entry.name == name) {
+            return entry.type;
+        }
+    }
+    return MessageType::Unknown;
+}
+
+constexpr std::string_view type_name(MessageType type) {
+    for (const auto &entry : kTypeNames) {
+        if (entry.type == type) {
+            return entry.name;
+        }
+    }
+    return {};
+}
+
+static_assert(classify("toggle_device") == MessageType::ToggleDevice);
+static_assert(classify("health") == MessageType::Health);
+static_assert(classify("toggle") == MessageType::Unknown);
+
+// Cadena de tamaño fijo construida en tiempo de compilación
+template <size_t N>
+struct FixedString {
+    char data[N]{};
+    size_t size = 0;
+
+    constexpr void append(std::string_view s) {
+        for (char c : s) {
+            data[size++] = c;
+        }
+    }
+    constexpr std::string_view view() const { return {data, size}; }
+};
+
+// {"type":"<nombre>"  — el resto de campos se añaden con ,"clave":valor
+template <MessageType T>
+constexpr auto build_prefix() {
+    constexpr std::string_view name = type_name(T);
+    static_assert(!name.empty(), "tipo de mensaje sin nombre");
+    FixedString<name.size() + 10> out;
+    out.append("{\"type\":\"");
+    out.append(name);
+    out.append("\"");
+    return out;
+}
+
+template <MessageType T>
+inline constexpr auto kPrefix = build_prefix<T>();
+
+static_assert(kPrefix<MessageType::Ack>.view() == "{\"type\":\"ack\"");
+
+// ---------------------------------------------------------------------------
+// Lectura
+
+// Valor de un campo tal como aparece en el texto. Las cadenas se devuelven sin
+// las comillas y sin decodificar escapes.
+struct Value {
+    std::string_view raw;
+    bool is_string = false;
+};
+
+namespace detail {
+
+constexpr bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+constexpr size_t skip_space(std::string_view s, size_t i) {
+    while (i < s.size() && is_space(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+// `i` apunta a la comilla de apertura; devuelve la posición de la de cierre
+constexpr size_t string_end(std::string_view s, size_t i) {
+    for (i++; i < s.size(); i++) {
+        if (s[i] == '\\') {
+            i++;
+        } else if (s[i] == '"') {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// Salta un valor cualquiera; devuelve la posición siguiente o npos si está mal formado
+constexpr size_t skip_value(std::string_view s, size_t i) {
+    if (i >= s.size()) {
+        return std::string_view::npos;
+    }
+    if (s[i] == '"') {
+        size_t end = string_end(s, i);
+        return end == std::string_view::npos ? end : end + 1;
+    }
+    if (s[i] == '{' || s[i] == '[') {
+        int depth = 0;
+        for (; i < s.size(); i++) {
+            char c = s[i];
+            if (c == '"') {
+                i = string_end(s, i);
+                if (i == std::string_view::npos) {
+                    return i;
+                }
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if (c == '}' || c == ']') {
+                if (--depth == 0) {
+                    return i + 1;
+                }
+            }
+        }
+        return std::string_view::npos;
+    }
+    while (i < s.size() && s[i] != ',' && s[i] != '}' && s[i] != ']' && !is_space(s[i])) {
+        i++;
+    }
+    return i;
+}
+
+}  // namespace detail
+
+// Busca `key` entre los campos de primer nivel del objeto `json`
+constexpr bool find(std::string_view json, std::string_view key, Value &out) {
+    size_t i = detail::skip_space(json, 0);
+    if (i >= json.size() || json[i] != '{') {
+        return false;
+    }
+    i++;
+    while (true) {
+        i = detail::skip_space(json, i);
+        if (i >= json.size() || json[i] != '"') {
+            return false;
+        }
+        size_t key_end = detail::string_end(json, i);
+        if (key_end == std::string_view::npos) {
+            return false;
+        }
+        std::string_view name = json.substr(i + 1, key_end - i - 1);
+        i = detail::skip_space(json, key_end + 1);
+        if (i >= json.size() || json[i] != ':') {
+            return false;
+        }
+        i = detail::skip_space(json, i + 1);
+        size_t value_end = detail::skip_value(json, i);
+        if (value_end == std::string_view::npos) {
+            return false;
+        }
+        if (name == key) {
+            bool quoted = json[i] == '"';
+            out.is_string = quoted;
+            out.raw = quoted ? json.substr(i + 1, value_end - i - 2) : json.substr(i, value_end - i);
+            return true;
+        }
+        i = detail::skip_space(json, value_end);
+        if (i >= json.size() || json[i] != ',') {
+            return false;
+        }
+        i++;
+    }
+}
+
+constexpr bool get_string(std::string_view json, std::string_view key, std::string_view &out) {
+    Value v;
+    if (!find(json, key, v) || !v.is_string) {
+        return false;
+    }
+    out = v.raw;
+    return true;
+}
+
+// Entero sin signo de hasta 32 bits; rechaza signos, decimales y desbordamientos
+constexpr bool get_u32(std::string_view json, std::string_view key, uint32_t &out) {
+    Value v;
+    if (!find(json, key, v) || v.is_string || v.raw.empty()) {
+        return false;
+    }
+    uint64_t n = 0;
+    for (char c : v.raw) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        n = n * 10 + static_cast<uint64_t>(c - '0');
+        if (n > 0xFFFFFFFFu) {
+            return false;
+        }
+    }
+    out = static_cast<uint32_t>(n);
+    return true;
+}
+
+constexpr MessageType message_type(std::string_view json) {
+    std::string_view name;
+    return get_string(json, "type", name) ? classify(name) : MessageType::Unknown;
+}
+
+static_assert(message_type(R"({"type": "toggle_device", "identifier": "led_1"})") == MessageType::ToggleDevice);
+static_assert(message_type(R"({"seq":{"a":"}"},"type":"clock"})") == MessageType::Clock);
+
+// ---------------------------------------------------------------------------
+// Escritura
+
+// Escribe un mensaje en un buffer fijo. Si no cabe, finish() devuelve 0 y el
+// buffer no debe enviarse.
+class Writer {
+public:
+    Writer(char *buf, size_t cap) : buf_(buf), cap_(cap) {}
+
+    template <MessageType T>
+    Writer &begin() {
+        len_ = 0;
+        overflow_ = false;
+        first_ = false;
+        raw(kPrefix<T>.view());
+        return *this;
+    }
+
+    // Tipo conocido sólo en tiempo de ejecución (interfaz C)
+    Writer &begin(MessageType type) {
+        len_ = 0;
+        overflow_ = false;
+        first_ = false;
+        raw("{\"type\":\"");
+        raw(type_name(type));
+        put('"');
+        return *this;
+    }
+
+    Writer &field(std::string_view key, std::string_view value) {
+        key_prefix(key);
+        put('"');
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                put('\\');
+            }
+            put(c);
+        }
+        put('"');
+        return *this;
+    }
+
+    Writer &field(std::string_view key, const char *value) { return field(key, std::string_view(value)); }
+
+    // Texto ya escapado, tal como lo devuelve get_string: se copia sin volver
+    // a escapar para que un valor recibido se devuelva igual
+    Writer &raw_field(std::string_view key, std::string_view escaped) {
+        key_prefix(key);
+        put('"');
+        raw(escaped);
+        put('"');
+        return *this;
+    }
+
+    Writer &field(std::string_view key, uint32_t value) {
+        key_prefix(key);
+        number(value);
+        return *this;
+    }
+
+    Writer &field(std::string_view key, int32_t value) {
+        key_prefix(key);
+        if (value < 0) {
+            put('-');
+        }
+        number(value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value));
+        return *this;
+    }
+
+    Writer &flag(std::string_view key, bool value) {
+        key_prefix(key);
+        raw(value ? "true" : "false");
+        return *this;
+    }
+
+    // Campo "on"/"off" de estado de una salida
+    Writer &state(std::string_view key, bool on) { return field(key, on ? std::string_view("on") : "off"); }
+
+    // Objeto anidado: los campos siguientes van dentro hasta close()
+    Writer &open(std::string_view key) {
+        key_prefix(key);
+        put('{');
+        first_ = true;
+        return *this;
+    }
+
+    Writer &close() {
+        put('}');
+        first_ = false;
+        return *this;
+    }
+
+    // Cierra el objeto y termina en '\0'. Devuelve la longitud sin el '\0'.
+    size_t finish() {
+        put('}');
+        if (overflow_ || len_ >= cap_) {
+            if (cap_ > 0) {
+                buf_[0] = '\0';
+            }
+            return 0;
+        }
+        buf_[len_] = '\0';
+        return len_;
+    }
+
+private:
+    void put(char c) {
+        if (len_ + 1 < cap_) {
+            buf_[len_++] = c;
+        } else {
+            overflow_ = true;
+        }
+    }
+
+    void raw(std::string_view s) {
+        for (char c : s) {
+            put(c);
+        }
+    }
+
+    void key_prefix(std::string_view key) {
+        if (!first_) {
+            put(',');
+        }
+        first_ = false;
+        put('"');
+        raw(key);
+        put('"');
+        put(':');
+    }
+
+    void number(uint32_t value) {
+        char digits[10];
+        size_t n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (n) {
+            put(digits[--n]);
+        }
+    }
+
+    char *buf_;
+    size_t cap_;
+    size_t len_ = 0;
+    bool overflow_ = false;
+    bool first_ = false;  // Recién abierto un objeto anidado: sin ',' delante
+};
+
+// Mensajes comunes a los dos firmwares
+
+// {"type":"device_connected","identifier":...,"ip":...[,"last_seq":n]}
+inline size_t write_device_connected(char *buf, size_t cap, std::string_view identifier, std::string_view ip,
+                                     const uint32_t *last_seq = nullptr) {
+    Writer w(buf, cap);
+    w.begin<MessageType::DeviceConnected>().field("identifier", identifier).field("ip", ip);
+    if (last_seq) {
+        w.field("last_seq", *last_seq);
+    }
+    return w.finish();
+}
+
+// {"type":"ack","seq":n[,"duplicate":true]}: confirma un comando sin otra
+// respuesta (repetido, desconocido o mal formado) para liberar su hueco en la
+// ventana de comandos del servidor
+inline size_t write_ack(char *buf, size_t cap, uint32_t seq, bool duplicate = false) {
+    Writer w(buf, cap);
+    w.begin<MessageType::Ack>().field("seq", seq);
+    if (duplicate) {
+        w.flag("duplicate", true);
+    }
+    return w.finish();
+}
+
+// Traza de un comando: identificador recibido en "trace" y tiempos medidos
+// en el dispositivo desde la recepción del mensaje (reloj local, µs)
+struct Trace {
+    std::string_view id;  // Tal como aparece en el comando, sin decodificar escapes
+    uint32_t apply_us;  // Recepción -> salida aplicada
+    uint32_t total_us;  // Recepción -> confirmación lista para enviar
+};
+
+// {"type":"state_update","identifier":...,"state":"on"|"off","ip":...[,"version":v][,"seq":n]
+//  [,"trace":id,"dev_apply_us":a,"dev_total_us":t]}
+inline size_t write_state_update(char *buf, size_t cap, std::string_view identifier, bool on, std::string_view ip,
+                                 const uint32_t *version = nullptr, const uint32_t *seq = nullptr,
+                                 const Trace *trace = nullptr) {
+    Writer w(buf, cap);
+    w.begin<MessageType::StateUpdate>().field("identifier", identifier).state("state", on).field("ip", ip);
+    if (version) {
+        w.field("version", *version);
+    }
+    if (seq) {
+        w.field("seq", *seq);
+    }
+    if (trace) {
+        w.raw_field("trace", trace->id).field("dev_apply_us", trace->apply_us).field("dev_total_us", trace->total_us);
+    }
+    return w.finish();
+}
+
+}  // namespace protocol
@@ -0,0 +1,52 @@
+// Coste por mensaje de la clasificación, la lectura de campos y la escritura
+// de la confirmación de un toggle_device, el camino más frecuente.
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "protocol_core.hpp"
+
+using namespace protocol;
+using Clock = std::chrono::steady_clock;
+
+template <typename F>
+static void bench(const char *name, int iterations, F &&body) {
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        body(i);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    std::printf("%-28s %8.1f ns/op\n", name, static_cast<double>(ns) / iterations);
+}
+
+int main() {
+    const int iterations = 2000000;
+    static const char *messages[] = {
+        R"({"type":"toggle_device","identifier":"led_1","state":"on","seq":41})",
+        R"({"type": "set_many", "mask": 5, "states": 1, "seq": 42})",
+        R"({"type":"state_ack","version":17})",
+        R"({"type":"clock","seconds":43200})",
+    };
+    volatile uint32_t sink = 0;
+
+    bench("message_type", iterations, [&](int i) {
+        sink = sink + static_cast<uint32_t>(message_type(messages[i & 3]));
+    });
+
+    bench("toggle_device fields", iterations, [&](int) {
+        std::string_view id, state;
+        uint32_t seq = 0;
+        get_string(messages[0], "identifier", id);
+        get_string(messages[0], "state", state);
+        get_u32(messages[0], "seq", seq);
+        sink = sink + static_cast<uint32_t>(id.size() + state.size()) + seq;
+    });
+
+    char buf[160];
+    bench("write_state_update", iterations, [&](int i) {
+        uint32_t version = static_cast<uint32_t>(i), seq = 41;
+        sink = sink + static_cast<uint32_t>(write_state_update(buf, sizeof(buf), "led_1", i & 1, "192.168.1.6",
+                                                               &version, &seq));
+    });
+
+    return sink == 0xFFFFFFFFu;
+}
@@ -0,0 +1,187 @@
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include "protocol_c.h"
+#include "protocol_core.hpp"
+
+using namespace protocol;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            std::printf("%s:%d: falla: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                  \
+        }                                                                \
+    } while (0)
+
+static void test_classify() {
+    for (const auto &entry : kTypeNames) {
+        CHECK(classify(entry.name) == entry.type);
+        CHECK(type_name(entry.type) == entry.name);
+    }
+    CHECK(classify("") == MessageType::Unknown);
+    CHECK(classify("state") == MessageType::Unknown);
+    CHECK(classify("toggle_device ") == MessageType::Unknown);
+}
+
+static void test_read() {
+    // Formato de Python (json.dumps) y del panel (JSON.stringify)
+    std::string_view spaced = R"({"type": "toggle_device", "identifier": "led_2", "state": "on", "seq": 42})";
+    std::string_view compact = R"({"identifier":"led_2","state":"off","seq":7,"type":"toggle_device"})";
+
+    CHECK(message_type(spaced) == MessageType::ToggleDevice);
+    CHECK(message_type(compact) == MessageType::ToggleDevice);
+
+    std::string_view s;
+    uint32_t n = 0;
+    CHECK(get_string(spaced, "identifier", s) && s == "led_2");
+    CHECK(get_string(compact, "state", s) && s == "off");
+    CHECK(get_u32(spaced, "seq", n) && n == 42);
+    CHECK(get_u32(compact, "seq", n) && n == 7);
+
+    // Campos anidados y cadenas con caracteres especiales no confunden la búsqueda
+    std::string_view nested = R"({"rules":[[0,5,0,1,1]],"meta":{"seq":1,"x":"},\"seq\":9"},"seq":3,"type":"rules"})";
+    CHECK(message_type(nested) == MessageType::Rules);
+    CHECK(get_u32(nested, "seq", n) && n == 3);
+
+    // Tipos y números no válidos
+    CHECK(!get_string(compact, "seq", s));
+    CHECK(!get_u32(compact, "state", n));
+    CHECK(!get_u32(R"({"seq":-1})", "seq", n));
+    CHECK(!get_u32(R"({"seq":1.5})", "seq", n));
+    CHECK(!get_u32(R"({"seq":4294967296})", "seq", n));
+    CHECK(get_u32(R"({"seq":4294967295})", "seq", n) && n == 4294967295u);
+    CHECK(!get_u32(R"({"other":1})", "seq", n));
+
+    // Texto mal formado o que no es un objeto
+    CHECK(message_type("") == MessageType::Unknown);
+    CHECK(message_type("[1,2]") == MessageType::Unknown);
+    CHECK(message_type(R"({"type":"clock")") == MessageType::Clock);
+    CHECK(message_type(R"({"type":"clo)") == MessageType::Unknown);
+    CHECK(message_type(R"({"a":{"b":1,"type":"clock"})") == MessageType::Unknown);
+}
+
+static void test_write() {
+    char buf[160];
+    uint32_t version = 12, seq = 5;
+
+    size_t len = write_state_update(buf, sizeof(buf), "led_1", true, "192.168.1.6", &version, &seq);
+    std::string_view expected =
+        R"({"type":"state_update","identifier":"led_1","state":"on","ip":"192.168.1.6","version":12,"seq":5})";
+    CHECK(std::string_view(buf, len) == expected);
+    CHECK(buf[len] == '\0');
+
+    len = write_device_connected(buf, sizeof(buf), "led_3", "10.0.0.2");
+    CHECK(std::string_view(buf, len) == R"({"type":"device_connected","identifier":"led_3","ip":"10.0.0.2"})");
+
+    // Las comillas se escapan y lo escrito se vuelve a leer igual
+    len = Writer(buf, sizeof(buf)).begin<MessageType::Ack>().field("note", "a\"b").field("seq", 0u).finish();
+    std::string_view s;
+    CHECK(message_type({buf, len}) == MessageType::Ack);
+    CHECK(get_string({buf, len}, "note", s) && s == "a\\\"b");
+
+    // Si no cabe no se devuelve un mensaje truncado
+    char small[24];
+    CHECK(write_state_update(small, sizeof(small), "led_1", false, "192.168.1.6") == 0);
+    CHECK(small[0] == '\0');
+    len = expected.size();
+    CHECK(write_state_update(buf, len, "led_1", true, "192.168.1.6", &version, &seq) == 0);
+    CHECK(write_state_update(buf, len + 1, "led_1", true, "192.168.1.6", &version, &seq) == len);
+
+    // La confirmación de un comando con traza devuelve el id y los tiempos locales
+    Trace trace{"k3x9", 120, 480};
+    len = write_state_update(buf, sizeof(buf), "led_1", true, "ip", nullptr, &seq, &trace);
+    CHECK(std::string_view(buf, len) ==
+          R"({"type":"state_update","identifier":"led_1","state":"on","ip":"ip","seq":5,)"
+          R"("trace":"k3x9","dev_apply_us":120,"dev_total_us":480})");
+
+    // El id de traza llega sin decodificar y se devuelve tal cual, sin escaparlo dos veces
+    const char *escaped_cmd = R"({"type":"toggle_device","trace":"a\"b\\c"})";
+    Trace echoed{{}, 1, 2};
+    CHECK(get_string(escaped_cmd, "trace", echoed.id));
+    len = write_state_update(buf, sizeof(buf), "led_1", false, "ip", nullptr, nullptr, &echoed);
+    CHECK(get_string({buf, len}, "trace", s) && s == echoed.id);
+    CHECK(std::string_view(buf, len).find(R"("trace":"a\"b\\c")") != std::string_view::npos);
+
+    // Objetos anidados y enteros con signo
+    len = Writer(buf, sizeof(buf))
+              .begin(MessageType::Health)
+              .field("rssi", int32_t{-67})
+              .open("stack_free")
+              .field("a", 1u)
+              .field("b", 2u)
+              .close()
+              .open("empty")
+              .close()
+              .field("n", int32_t{2147483647})
+              .field("m", int32_t{-2147483647 - 1})
+              .finish();
+    CHECK(std::string_view(buf, len) == R"({"type":"health","rssi":-67,"stack_free":{"a":1,"b":2},"empty":{},)"
+                                        R"("n":2147483647,"m":-2147483648})");
+    CHECK(message_type({buf, len}) == MessageType::Health);
+
+    len = write_ack(buf, sizeof(buf), 7);
+    CHECK(std::string_view(buf, len) == R"({"type":"ack","seq":7})");
+    len = write_ack(buf, sizeof(buf), 8, true);
+    CHECK(std::string_view(buf, len) == R"({"type":"ack","seq":8,"duplicate":true})");
+}
+
+static void test_c_api() {
+    const char *msg = R"({"type":"set_many","mask":5,"states":1})";
+    size_t len = std::strlen(msg);
+    uint32_t mask = 0;
+    CHECK(proto_message_type(msg, len) == PROTO_MSG_SET_MANY);
+    CHECK(proto_get_u32(msg, len, "mask", &mask) && mask == 5);
+
+    const char *value = nullptr;
+    size_t value_len = 0;
+    CHECK(proto_get_string(msg, len, "type", &value, &value_len) && std::string_view(value, value_len) == "set_many");
+
+    char buf[128];
+    CHECK(proto_write_state_update(buf, sizeof(buf), "led_2", false, "ip", nullptr, nullptr, nullptr) ==
+          std::strlen(R"({"type":"state_update","identifier":"led_2","state":"off","ip":"ip"})"));
+
+    const char *cmd = R"({"type":"toggle_device","identifier":"led_2","trace":"t1"})";
+    proto_trace_t trace = {nullptr, 0, 7, 9};
+    CHECK(proto_get_string(cmd, std::strlen(cmd), "trace", &trace.id, &trace.id_len));
+    size_t out = proto_write_state_update(buf, sizeof(buf), "led_2", true, "ip", nullptr, nullptr, &trace);
+    CHECK(std::string_view(buf, out) ==
+          R"({"type":"state_update","identifier":"led_2","state":"on","ip":"ip","trace":"t1","dev_apply_us":7,"dev_total_us":9})");
+
+    out = proto_write_ack(buf, sizeof(buf), 3, false);
+    CHECK(std::string_view(buf, out) == R"({"type":"ack","seq":3})");
+
+    proto_writer_t w;
+    proto_writer_begin(&w, buf, sizeof(buf), PROTO_MSG_STATE_DELTA);
+    proto_writer_u32(&w, "from", 4);
+    proto_writer_open(&w, "states");
+    proto_writer_state(&w, "led_1", true);
+    proto_writer_state(&w, "led_3", false);
+    proto_writer_close(&w);
+    proto_writer_i32(&w, "rssi", -5);
+    proto_writer_bool(&w, "ok", true);
+    proto_writer_str(&w, "ip", "ip");
+    out = proto_writer_finish(&w);
+    CHECK(std::string_view(buf, out) ==
+          R"({"type":"state_delta","from":4,"states":{"led_1":"on","led_3":"off"},"rssi":-5,"ok":true,"ip":"ip"})");
+
+    char small[16];
+    proto_writer_begin(&w, small, sizeof(small), PROTO_MSG_RULES_LOADED);
+    proto_writer_bool(&w, "ok", true);
+    CHECK(proto_writer_finish(&w) == 0);
+}
+
+int main() {
+    test_classify();
+    test_read();
+    test_write();
+    test_c_api();
+    if (failures) {
+        std::printf("%d comprobaciones fallidas\n", failures);
+        return 1;
+    }
+    std::printf("OK\n");
+    return 0;
+}